@@ -7,6 +7,7 @@
 #include "Network.h"
 #include "RoomList.h"
 #include "OnlineGame.h"
+#include <atomic>
 #include <fstream>
 #include <boost/asio.hpp>
 
@@ -17,6 +18,10 @@ public:
     Application();
     ~Application();
     void run();
+    void playReplay(const std::string& path, bool realtime, std::size_t gameIndex = 0, std::uint32_t startTick = 0);
+    void setNetworkImpairment(const ImpairmentSettings& settings);
+    void setRollback(bool enabled);
+    void setBot(bool enabled, bool search = false);
     void handleMultiplayerMode();
     void createRoom();
     void joinRoom();
@@ -30,7 +35,7 @@ private:
     Game* game;
     OnlineGame* onlineGame;
     Network network;
-    bool startTogether = false;
+    std::atomic<bool> startTogether{false}; // Set by the network thread on START_GAME
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,97 @@
+#ifndef BEAM_SEARCH_H
+#define BEAM_SEARCH_H
+
+#include "Block.h"
+#include "Evaluator.h"
+#include "Grid.h"
+#include "Placement.h"
+#include "ThreadPool.h"
+#include "TranspositionTable.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+
+struct SearchSettings {
+    std::size_t beamWidth = 64;                     // Boards kept after every piece
+    int depth = 3;                                  // Pieces, counting the current one
+    std::chrono::microseconds budget{5000};         // Per move, a level that does not finish in time is dropped
+    unsigned threads = std::thread::hardware_concurrency();
+    std::size_t tableEntries = std::size_t{1} << 14;  // Boards remembered across searches, 256 KB stays in cache
+};
+
+struct SearchResult {
+    bool found = false;             // False when the piece can not be placed at all
+    Placement placement{};          // Where the current piece should go
+    double score = 0;
+    int depthReached = 0;           // Pieces the search looked at within the budget
+    std::size_t evaluated = 0;      // Placements scored
+    std::size_t cacheHits = 0;      // Of those, boards found in the transposition table
+};
+
+// Looks several pieces ahead: the current piece, the preview, and after
+// those the average over all seven pieces, since which one comes next is
+// not known. Each level places the next piece on every board in the beam
+// and keeps the best boards. The boards of a level are spread over a work
+// stealing pool; every worker scores into its own arena, so nothing is
+// shared while scoring and the candidates are merged once the level is done.
+// Boards reached by different move orders are scored once: every score
+// goes into a transposition table keyed by the board's hash, and the beam
+// keeps only one of equal boards.
+class BeamSearch {
+public:
+    static constexpr double GAME_OVER_SCORE = -1e6;
+
+    explicit BeamSearch(const SearchSettings& settings = SearchSettings());
+
+    // The piece starts where it is now, the preview pieces at the spawn
+    SearchResult search(const Grid& grid, const Block& piece, const std::vector<BlockType>& preview,
+                        const EvalWeights& weights);
+
+    const SearchSettings& getSettings() const { return settings; }
+
+private:
+    struct Node {
+        Grid grid;
+        int lines = 0;              // Cleared on the way here
+        Placement root{};           // Placement of the current piece that leads here
+        double score = 0;
+    };
+    struct Candidate {
+        double score;
+        int parent;
+        Placement placement;
+        std::uint64_t hash;         // Of the board it leaves
+        int lines;                  // It clears
+    };
+    struct Arena {
+        PlacementFinder finder;
+        std::vector<Candidate> candidates;
+        std::size_t evaluated = 0;
+        std::size_t cacheHits = 0;
+    };
+
+    Arena& arena();
+    double boardValue(Arena& own, const Grid& grid, const Block& piece, std::uint64_t hash, int depth);
+    void expand(Arena& own, int parent, const Block& piece, int depth);
+    double averageOverPieces(Arena& own, const Node& node, int depth);
+    bool keepBest(BlockType type, bool firstPiece);
+    bool pastDeadline();
+
+    SearchSettings settings;
+    ThreadPool pool;
+    TranspositionTable table;
+    EvalWeights boardWeights;       // Lines are scored apart, the table holds boards only
+    double lineScore = 0;
+    std::vector<std::unique_ptr<Arena>> arenas;    // One per worker, the last for the searching thread
+    std::vector<Node> beam;
+    std::vector<Node> nextBeam;
+    std::vector<Candidate> merged;
+    std::vector<double> averages;
+    std::chrono::steady_clock::time_point deadline;
+    std::atomic<bool> outOfTime{false};
+};
+
+#endif // BEAM_SEARCH_H
@@ -1,30 +1,53 @@
 #ifndef BLOCK_H
 #define BLOCK_H
 
+#include <array>
+#include <cstdint>
 #include <vector>
 #include <string>
+#include "Rng.h"
 
 enum BlockType { I, O, T, L, J, Z, S };
 
+// One orientation of a block as row bitmasks, bit j is column j
+struct BlockShape {
+    std::uint8_t width;
+    std::uint8_t height;
+    std::array<std::uint8_t, 4> rows;
+};
+
+// A plain value, every orientation comes from a table built once
 class Block {
 public:
-    Block();
+    static constexpr int SPAWN_X = 3; // Center of the grid
+    static constexpr int SPAWN_Y = 0; // Top of the grid
+
+    Block() = default;
+    explicit Block(Rng& rng);
+    Block(BlockType type, int color, int x, int y, int rotation);
     void rotate();
     void move(int dx, int dy);
+    const BlockShape& getCells() const;
+    static const BlockShape& shapeOf(BlockType type, int rotation);
     std::vector<std::vector<int>> getShape() const;
     BlockType getType() const;
     int getColor() const;
     int getX() const;
     int getY() const;
+    int getRotation() const;
     
     std::string serialize() const;
     void deserialize(const std::string& data);
 
 private:
-    BlockType type;
-    std::vector<std::vector<int>> shape;
-    int x, y;
-    int color;
+    BlockType type = I;
+    int x = 0, y = 0;
+    int color = 0;
+    int rotation = 0; // Quarter turns from the spawn orientation
 };
 
+// Blocks only use a small palette, saved replay states store the index
+int basicColorIndex(int color);
+int basicColor(int index);
+
 #endif
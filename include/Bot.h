@@ -0,0 +1,54 @@
+#ifndef BOT_H
+#define BOT_H
+
+#include "BeamSearch.h"
+#include "Block.h"
+#include "Evaluator.h"
+#include "Placement.h"
+#include "Replay.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class Game;
+
+// Plays a game in place of the keyboard. For each new piece every resting
+// place is scored by the evaluator and the best one is steered to with the
+// same inputs a player would press, so bot games record and replay like
+// any other. When the piece is not where the plan expects, because it fell
+// or a move did not fit, the bot plans again from where it is. With a
+// search set, the placement comes from a beam search through the preview
+// instead of the current piece alone.
+class Bot {
+public:
+    static constexpr int DEFAULT_INPUTS_PER_TICK = 1;
+
+    explicit Bot(const EvalWeights& weights = EvalWeights(), int inputsPerTick = DEFAULT_INPUTS_PER_TICK);
+
+    void setSearch(std::unique_ptr<BeamSearch> newSearch);
+
+    // Called once per simulation tick, before the tick runs
+    void play(Game& game);
+
+private:
+    bool onPlan(const Block& piece) const;
+    void plan(const Grid& grid, const Block& piece, BlockType next);
+    void aim(const Grid& grid, const Block& piece, const Placement& placement);
+
+    PlacementFinder finder;
+    std::unique_ptr<BeamSearch> search;
+    EvalWeights weights;
+    int inputsPerTick;
+    std::vector<InputAction> path;
+    std::size_t pathIndex = 0;
+    Block expected;             // Where the piece should be after the inputs so far
+    bool planned = false;
+    Placement target{};         // Chosen for the current piece on the board below
+    BlockType targetType = I;
+    std::array<std::uint16_t, Grid::MAX_HEIGHT> targetRows{};
+    bool targeted = false;
+};
+
+#endif // BOT_H
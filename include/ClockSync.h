@@ -0,0 +1,56 @@
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Estimates the clock of a remote peer from ping exchanges, NTP style. The
+// peer stamps its PONG with its own clock, which read that time somewhere
+// in the middle of our round trip. Exchanges with the shortest round trips
+// waited least in queues, so the offset comes from the best quarter of a
+// recent window. The drift between the two crystals is too small to see in
+// one window and is measured against the first estimate instead.
+class ClockSync {
+public:
+    static constexpr std::size_t WINDOW = 16;
+    static constexpr std::size_t MIN_SAMPLES = 4;          // Before the estimate is trusted
+    static constexpr double MIN_DRIFT_SPAN_MS = 60000.0;    // Drift only shows over minutes
+    static constexpr double MAX_DRIFT_PPM = 500.0;          // Anything larger is noise, not a crystal
+
+    void reset();
+
+    // One exchange: the local send and receive times and the remote time in the PONG
+    void addSample(double sentMs, double remoteMs, double receivedMs);
+
+    // The remote clock at a local time
+    double toRemote(double localMs) const;
+
+    bool synced() const { return count >= MIN_SAMPLES; }
+    std::size_t samples() const { return count; }
+    double offsetMs() const { return offset; }              // Remote minus local at the newest sample
+    double driftPpm() const { return drift * 1e6; }
+    double bestRttMs() const { return bestRtt; }
+
+private:
+    struct Sample {
+        double localMs;
+        double offsetMs;
+        double rttMs;
+    };
+
+    void refit();
+
+    std::array<Sample, WINDOW> window{};
+    std::size_t next = 0;
+    std::size_t count = 0;
+    double anchorMs = 0.0;      // Local time of the newest sample, the offset holds there
+    double offset = 0.0;
+    double drift = 0.0;         // Remote ms gained per local ms
+    double bestRtt = 0.0;
+    bool baseSet = false;       // First trusted estimate, drift is measured against it
+    double baseLocalMs = 0.0;
+    double baseOffsetMs = 0.0;
+};
+
+#endif // CLOCK_SYNC_H
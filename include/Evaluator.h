@@ -0,0 +1,41 @@
+#ifndef EVALUATOR_H
+#define EVALUATOR_H
+
+#include "Block.h"
+#include "Grid.h"
+
+// Shape of a board after a piece was placed, what the bots judge it by
+struct BoardFeatures {
+    int aggregateHeight = 0;    // Sum of the column heights
+    int holes = 0;              // Empty cells with a filled one somewhere above
+    int bumpiness = 0;          // Sum of height differences between neighbouring columns
+    int rowTransitions = 0;     // Changes between filled and empty along the rows, walls count as filled
+    int columnTransitions = 0;  // Changes between filled and empty down the columns, the floor counts as filled
+    int wells = 0;              // Over every well, 1 + 2 + ... + its depth
+    int linesCleared = 0;
+};
+
+// How much each feature is worth, a placement scores the weighted sum
+struct EvalWeights {
+    double aggregateHeight = -1.0;
+    double holes = -7.9;
+    double bumpiness = -0.5;
+    double rowTransitions = -3.2;
+    double columnTransitions = -9.3;
+    double wells = -3.4;
+    double linesCleared = 3.4;
+
+    bool operator==(const EvalWeights&) const = default;
+};
+
+// Every feature comes from the grid's row masks: one word holds a whole
+// row, so a count over the columns is a popcount, and well depths are kept
+// as bit planes, one bit per column in each.
+BoardFeatures measureBoard(const Grid& grid, int linesCleared);
+double scoreBoard(const BoardFeatures& features, const EvalWeights& weights);
+
+// Places the piece on a copy of the grid and scores the result. A search
+// passes the lines its earlier placements cleared, they count as well.
+double scorePlacement(const Grid& grid, const Block& piece, const EvalWeights& weights, int earlierLines = 0);
+
+#endif // EVALUATOR_H
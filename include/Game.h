@@ -3,14 +3,61 @@
 
 #include <SDL.h>
 #include "Block.h"
+#include "GameState.h"
 #include "Grid.h"
+#include "Replay.h"
+#include "Rng.h"
+#include <cstdint>
+#include <memory>
+
+class Bot;
 
 class Game {
 public:
+    // Rules, recorded in every replay
+    static constexpr int GRID_WIDTH = 10;
+    static constexpr int GRID_HEIGHT = 20;
+    static constexpr Uint32 TICK_MS = 16;          // The simulation advances in fixed steps
+    static constexpr unsigned int INITIAL_SPEED = 1000;
+    static constexpr unsigned int MIN_SPEED = 200;
+    static constexpr unsigned int SPEED_STEP = 10;
+
     Game(SDL_Renderer* renderer);
-    ~Game();
+    virtual ~Game();
 
     void reset();
+    void reset(std::uint64_t newSeed);
+    bool applyInput(InputAction action);
+    void step();
+    static ReplaySettings settings();
+
+    // With a bot set, it plays every tick and the arrow keys do nothing
+    void setBot(std::unique_ptr<Bot> newBot);
+
+    // Replays: runReplay simulates without rendering and tells whether the
+    // result matches the recording, showReplay plays it back on screen.
+    // seekReplay resumes from a keyframe (or the start) and runs to the tick.
+    void startPlayback(const Replay& replay);
+    bool runReplay(const Replay& replay);
+    void seekReplay(const Replay& replay, const ReplayKeyframe* keyframe, std::uint32_t targetTick);
+    void showReplay(const Replay& replay, bool realtime, const ReplayKeyframe* keyframe = nullptr, std::uint32_t startTick = 0);
+
+    // The whole simulation as one flat value. Restoring keeps a replay being
+    // played back, its inputs continue after eventIndex. A live game drops
+    // the inputs recorded after the state, as an undo would.
+    GameState save() const;
+    void restore(const GameState& state);
+
+    ReplayKeyframe captureKeyframe() const;
+    void restoreKeyframe(const ReplayKeyframe& keyframe);
+
+    int getScore() const { return score; }
+    std::uint32_t getTick() const { return tick; }
+    bool isGameOver() const { return gameOver; }
+    const Grid& getGrid() const { return grid; }
+    const Block& getCurrentBlock() const { return currentBlock; }
+    const Block& getNextBlock() const { return nextBlock; }
+
     virtual void show();
     virtual void handleInput();
     virtual void update(Uint32 deltaTime);
@@ -19,25 +66,46 @@ public:
 
 protected:
     SDL_Renderer* renderer;
+    Grid grid;          // Near the top, so saving it is an aligned copy
+    Block currentBlock;
+    Block nextBlock;
     
     bool gameStarted = false;
     bool quit;
     bool gameOver;
-    
-    Block* currentBlock;
-    Block* nextBlock;
-    Grid* grid;
 
     int score;
     unsigned int speed;
     int timer;
+
+    std::uint64_t seed;
+    Rng rng;
+    std::uint32_t tick = 0;
+    Uint32 tickAccumulator = 0;
+    Replay recording;
+    const Replay* playback = nullptr;  // Inputs come from here instead of the keyboard
+    std::unique_ptr<Bot> bot;          // Or from here, when not playing back
+    std::size_t playbackIndex = 0;
+
+    // The current block and grid the landing row was found for
+    Block ghostBlock;
+    std::uint64_t ghostGrid = 0;
+    int ghostRow = -1;
     
+    virtual void handleExtraKey(SDL_Keycode key) { (void)key; } // Keys the base game does not use
+    virtual void renderOverlay() {} // Drawn on top of the board before the frame is presented
     void renderStatusBox(int windowWidth, int windowHeight);
-    void renderBlock(Block* block, SDL_Rect displayArea);
+    void renderBlock(const Block& block, SDL_Rect displayArea);
     void renderGameOver();
+    void saveRecording();
+    void lockBlock();
+    int ghostLandingRow();  // Of the current block, cached for drawing
 
 private:
+    static constexpr Uint32 MAX_FRAME_MS = 250; // Long stalls do not turn into a burst of ticks
+
     bool paused;
+    bool finishPlayback(const Replay& replay);
     void showPauseMenu();
 };
 
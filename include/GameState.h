@@ -0,0 +1,57 @@
+#ifndef GAME_STATE_H
+#define GAME_STATE_H
+
+#include "Block.h"
+#include "Grid.h"
+#include "Rng.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// Everything the simulation of one game depends on, in one flat value of
+// fixed size. Saving or restoring it is a plain copy without allocations,
+// cheap enough to do every tick.
+struct GameState {
+    Grid grid;
+    Block current;
+    Block next;
+    Rng rng;
+    std::uint32_t tick = 0;
+    std::uint32_t eventIndex = 0;   // Inputs of the game applied so far
+    int score = 0;
+    unsigned int speed = 0;
+    int timer = 0;
+    bool gameOver = false;
+};
+
+static_assert(std::is_trivially_copyable_v<GameState>, "GameState is copied as raw memory");
+
+// The states of the last N ticks, the one of tick t sits at t % N
+template <std::size_t N>
+class GameStateRing {
+public:
+    static constexpr std::uint32_t NO_TICK = 0xFFFFFFFF;
+
+    GameStateRing() { clear(); }
+
+    void clear() { ticks.fill(NO_TICK); }
+
+    void save(const GameState& state) {
+        std::size_t slot = state.tick % N;
+        states[slot] = state;
+        ticks[slot] = state.tick;
+    }
+
+    // Null once the tick was overwritten by a newer one, or never saved
+    const GameState* find(std::uint32_t tick) const {
+        std::size_t slot = tick % N;
+        return ticks[slot] == tick ? &states[slot] : nullptr;
+    }
+
+private:
+    std::array<GameState, N> states{};
+    std::array<std::uint32_t, N> ticks{};
+};
+
+#endif // GAME_STATE_H
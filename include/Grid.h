@@ -3,13 +3,26 @@
 
 #include "Block.h"
 #include <SDL.h>
+#include <array>
+#include <bit>
+#include <cstdint>
 #include <vector>
 #include <string>
 
+// A plain value of fixed size, so game states copy without allocating. Each
+// row is also kept as a bitmask, a whole block is tested in a few ANDs.
+// A 64 bit Zobrist hash of the filled cells is kept up to date as blocks
+// are placed and lines cleared, equal boards have equal hashes. So are the
+// column heights and holes, asking for them costs nothing.
 class Grid {
 public:
+    static constexpr int MAX_WIDTH = 16;  // Bits of a row mask
+    static constexpr int MAX_HEIGHT = 24;
+
+    Grid() = default;
     Grid(int width, int height);
     bool canPlace(const Block& block) const;
+    int landingRow(const Block& block) const;   // Where the block stops falling
     void placeBlock(const Block& block);
     int clearLines();
     void render(SDL_Renderer* renderer, int windowWidth, int windowHeight);
@@ -24,19 +37,49 @@ public:
     void deserialize(const std::string& data);
     int getWidth() const { return width; }
     int getHeight() const { return height; }
-    std::vector<std::vector<int>> getGrid() const { return grid; }
-    std::vector<std::vector<int>> getGridColors() const { return gridColors; }
+    std::vector<std::vector<int>> getGrid() const;
+    std::vector<std::vector<int>> getGridColors() const;
+    std::uint16_t getRow(int y) const { return rows[y]; } // Bit x is column x
+    const std::array<std::uint16_t, MAX_HEIGHT>& getRows() const { return rows; } // Empty below the height
+    int getCellColor(int x, int y) const { return colors[y][x] ? basicColor(colors[y][x] - 1) : 0; }
+    void setCell(int x, int y, int color); // 0 empties the cell
+
+    // Filled cells of a row, a row is full at the width
+    int getRowFill(int y) const { return std::popcount(rows[y]); }
+    // Rows from the column's highest filled cell down, 0 when empty
+    int getColumnHeight(int x) const { return columnHeights[x]; }
+    int getAggregateHeight() const { return aggregateHeight; }
+    // Empty cells with a filled one somewhere above
+    int getColumnHoles(int x) const { return columnHoles[x]; }
+    int getHoles() const { return holes; }
+
+    std::uint64_t getHash() const { return hash; }
+    // The hash after placing the block and clearing full lines, without
+    // changing the grid. Cheap unless the block fills a line.
+    std::uint64_t hashAfter(const Block& block, int& linesCleared) const;
 
 private:
-    int width, height;
-    std::vector<std::vector<int>> grid;
-    std::vector<std::vector<int>> gridColors;
-
-    int gridPixelWidth;
-    int gridPixelHeight;
-    int cellSize;
-    int gridXOffset;
-    int gridYOffset;
+    void addToColumn(int x, int y);
+    void recountColumn(int x);
+    void removeFromColumns(int y);
+    void markChanged(int y);
+
+    int width = 0, height = 0;
+    std::array<std::uint16_t, MAX_HEIGHT> rows{};
+    std::uint64_t hash = 0;
+    std::array<std::uint8_t, MAX_WIDTH> columnHeights{};
+    std::array<std::uint8_t, MAX_WIDTH> columnHoles{};
+    int aggregateHeight = 0;
+    int holes = 0;
+    int changedTop = MAX_HEIGHT;    // Rows set since the last clearLines, the only ones that can be full
+    int changedBottom = -1;
+    std::array<std::array<std::uint8_t, MAX_WIDTH>, MAX_HEIGHT> colors{}; // Palette index + 1, 0 when empty
+
+    int gridPixelWidth = 0;
+    int gridPixelHeight = 0;
+    int cellSize = 0;
+    int gridXOffset = 0;
+    int gridYOffset = 0;
 };
 
 #endif
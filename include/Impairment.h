@@ -0,0 +1,64 @@
+#ifndef IMPAIRMENT_H
+#define IMPAIRMENT_H
+
+#include <boost/asio.hpp>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include "Rng.h"
+
+// A simulated bad link, all zero is a perfect one
+struct ImpairmentSettings {
+    double delayMs = 0.0;        // Added to every datagram
+    double jitterMs = 0.0;       // Uniform extra delay in [0, jitterMs)
+    double lossRate = 0.0;       // Fractions in [0, 1]
+    double duplicateRate = 0.0;
+    double reorderRate = 0.0;    // Held back long enough for later datagrams to overtake it
+    std::uint64_t seed = 1;
+
+    bool active() const { return delayMs > 0.0 || jitterMs > 0.0 || lossRate > 0.0 || duplicateRate > 0.0 || reorderRate > 0.0; }
+};
+
+// Parse "delay=40,jitter=10,loss=2,dup=1,reorder=5,seed=7", times in ms and
+// rates in percent, false on an unknown key or a bad number
+bool parseImpairment(std::string_view spec, ImpairmentSettings& settings);
+
+// Sits between a sender and its UDP socket and makes outgoing datagrams late,
+// lost, doubled or out of order on purpose, so the features that hide a bad
+// network can be measured over loopback under the same conditions every run.
+// The send handler runs as soon as a datagram is handed to the simulated
+// link, the way a real socket knows nothing of what happens on the wire.
+// Everything runs on the executor given to the constructor.
+class ImpairedLink {
+public:
+    using SendHandler = std::function<void(const boost::system::error_code&, std::size_t)>;
+    static constexpr double REORDER_DELAY_MS = 100.0;   // Overtaken by the next states even at 20 Hz
+
+    ImpairedLink(boost::asio::ip::udp::socket& socket, boost::asio::any_io_executor executor);
+
+    void configure(const ImpairmentSettings& settings);
+    const ImpairmentSettings& settings() const { return current; }
+
+    void send(std::shared_ptr<std::string> datagram, const boost::asio::ip::udp::endpoint& target, SendHandler handler);
+
+    // What the link did so far
+    std::uint64_t dropped() const { return droppedCount; }
+    std::uint64_t duplicated() const { return duplicatedCount; }
+    std::uint64_t reordered() const { return reorderedCount; }
+
+private:
+    void sendAfter(std::shared_ptr<std::string> datagram, const boost::asio::ip::udp::endpoint& target, double delayMs);
+    double uniform() { return static_cast<double>(rng.next() >> 11) * 0x1.0p-53; }
+
+    boost::asio::ip::udp::socket& socket;
+    boost::asio::any_io_executor executor;
+    ImpairmentSettings current;
+    Rng rng;
+    std::uint64_t droppedCount = 0;
+    std::uint64_t duplicatedCount = 0;
+    std::uint64_t reorderedCount = 0;
+};
+
+#endif // IMPAIRMENT_H
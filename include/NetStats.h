@@ -0,0 +1,75 @@
+#ifndef NET_STATS_H
+#define NET_STATS_H
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Histogram of millisecond samples with power of two buckets: <1, <2, <4, ... , >=1024
+class LatencyHistogram {
+public:
+    static constexpr int BUCKETS = 12;
+
+    void add(double ms);
+    double percentile(double fraction) const; // Upper bound of the bucket holding the fraction
+    std::uint32_t count() const { return samples; }
+    double mean() const { return samples ? sum / samples : 0.0; }
+    double min() const { return samples ? minValue : 0.0; }
+    double max() const { return maxValue; }
+
+private:
+    std::array<std::uint32_t, BUCKETS> buckets{};
+    std::uint32_t samples = 0;
+    double sum = 0.0;
+    double minValue = 0.0;
+    double maxValue = 0.0;
+};
+
+// Counters for one remote endpoint, updated on the network strand
+struct PeerStats {
+    std::uint64_t packetsIn = 0;
+    std::uint64_t packetsOut = 0;
+    std::uint64_t messagesOut = 0;       // Before coalescing, several can share one packet
+    std::uint64_t bytesIn = 0;
+    std::uint64_t bytesOut = 0;
+    std::uint64_t packetsLost = 0;       // Sequence gaps not filled by late packets
+    std::uint64_t packetsReordered = 0;  // Packets that arrived after a later one
+    std::uint64_t packetsDuplicated = 0; // Copies of a packet that already arrived
+
+    double lastRttMs = 0.0;
+    double smoothedRttMs = 0.0;          // EWMA with gain 1/8, like TCP SRTT
+    double jitterMs = 0.0;               // EWMA of RTT deltas with gain 1/16 (RFC 3550)
+    LatencyHistogram rtt;
+
+    std::uint32_t sendQueueDepth = 0;    // Sends handed to the socket but not completed
+    std::uint32_t maxSendQueueDepth = 0;
+
+    double sendRateBytes = 0.0;          // Game state budget chosen by the rate controller
+    double remoteLossRate = 0.0;         // Loss of our packets, as reported by the peer
+    std::uint64_t statesSuperseded = 0;  // Game states replaced by a newer one before they went out
+
+    std::uint16_t nextOutgoingSequence = 0;
+
+    void onReceive(std::uint16_t sequence, std::size_t bytes);
+    void onRttSample(double ms);
+    double lossRate() const;
+
+private:
+    static constexpr int HISTORY = 64;  // Sequences below the highest that are remembered
+
+    bool hasIncoming = false;
+    std::uint16_t highestIncoming = 0;
+    // Bit k is the sequence k below the highest: received, or counted as lost
+    std::uint64_t received = 0;
+    std::uint64_t missing = 0;
+};
+
+// One CSV row per peer, the header matches writeStatsRow
+void writeStatsHeader(std::ostream& out);
+void writeStatsRow(std::ostream& out, std::uint64_t timeMs, const std::string& peer, const PeerStats& stats);
+
+// Short human readable summary for the overlay
+std::string formatStatsLine(const std::string& peer, const PeerStats& stats);
+
+#endif // NET_STATS_H
@@ -2,11 +2,24 @@
 #define NETWORK_H
 
 #include <boost/asio.hpp>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
 #include <functional>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <mutex>
 #include <atomic>
+#include "ClockSync.h"
+#include "Impairment.h"
+#include "NetStats.h"
+#include "PeerTable.h"
+#include "Protocol.h"
+#include "RateControl.h"
+#include "Reassembly.h"
 #include "RoomView.h"
 
 class Network {
@@ -17,9 +30,9 @@ public:
     // Room management methods
     void startListening(int port);
     int stopListening();
-    bool joinRoom(const std::string& address, int port);
+    bool joinRoom(const std::string& address, int port, const std::string& playerName = "");
     void broadcastRoomState(const std::string& message, int port);
-    void initializeEndPoints();
+    void initializeEndPoints();    // The host as its own first peer, after startListening
 
     // Player management methods
     void addPlayer(const std::string& playerName);
@@ -30,18 +43,40 @@ public:
 
     // Game state management methods
     void broadcastGameState(const std::string& state);
-    std::vector<std::pair<std::string, std::string>> receiveGameStateUpdates();
+    void broadcastInputs(const std::string& inputs);
     bool allPlayersReady() const;
     void startGameSession();
 
-    // Callback setters
-    void setNotifyGameStateCallback(const std::function<void(const std::string&, const std::string&)>& callback);
+    // Callback setters, game states are handed over with the id of the peer that sent them
+    void setNotifyGameStateCallback(const std::function<void(PeerId, std::string_view)>& callback);
+    void setNotifyInputsCallback(const std::function<void(PeerId, std::string_view)>& callback);
     void setOnGameStartCallback(const std::function<void()>& callback);
+    // On the network thread, when a peer timed out, restarted, or its id goes to
+    // another endpoint. No lock is held, so the handler may call back into Network.
+    void setOnPeerLeftCallback(const std::function<void(PeerId)>& callback);
 
     // Room view management methods
     void initializeRoomView(SDL_Renderer* renderer, bool isHost, const std::string& playerName);
+    void releaseRoomView();
     void handleReadyState(const std::string& message);
 
+    // Shared match timeline. The host's clock is the match clock and a client
+    // follows it through its pings to the host. Safe to call from any thread.
+    std::uint32_t getMatchTimeMs() const;
+    std::uint32_t getMatchTick() const { return getMatchTimeMs() / MATCH_TICK_MS; }
+    std::uint32_t getStartTick() const { return startTick.load(); }  // From START_GAME
+    ClockSync getClockSync() const;
+
+    // Simulated link conditions for outgoing datagrams, for testing over loopback
+    void setImpairment(const ImpairmentSettings& settings);
+
+    // Statistics, safe to call from the UI thread
+    std::vector<std::pair<std::string, PeerStats>> getPeerStats() const;
+    bool getPeerStats(PeerId peer, PeerStats& stats) const;
+    std::string getPeerName(PeerId peer) const;
+    void recordFrameTime(double ms);
+    LatencyHistogram getFrameTimeStats() const;
+
     // TCP methods
     std::string getLocalIPAddress();
     boost::asio::ip::udp::endpoint getHostEndpoint() const;
@@ -49,31 +84,152 @@ public:
     // Callbacks
     std::function<void(const std::string&)> onRoomStateUpdate;
 
-    // Public member variables
-    RoomView* roomView;
+    // Public member variables, the network thread only touches roomView under roomViewMutex
+    RoomView* roomView = nullptr;
     std::mutex roomViewMutex;
 
 private:
+    // Receive buffers come from a fixed pool, each slot keeps one receive outstanding
+    static constexpr std::size_t RECEIVE_SLOTS = 4;
+    static constexpr std::size_t RECEIVE_BUFFER_SIZE = 1500; // Room for a full Ethernet frame, we send at most MAX_DATAGRAM_SIZE
+    struct ReceiveSlot {
+        std::array<char, RECEIVE_BUFFER_SIZE> data;
+        boost::asio::ip::udp::endpoint sender;
+    };
+
+    // Handlers are indexed by opcode and get the payload without the opcode byte
+    using MessageHandler = void (Network::*)(PeerId, std::string_view);
+
     // Internal methods
     void listenForUpdates();
-    void handleRoomStateUpdate(const std::string& message);
-    void handleJoinRoomRequest(const boost::asio::ip::udp::endpoint& clientEndpoint, const std::string& message);
-    void handlePlayerListUpdate(const std::string& message);
+    void receiveInto(ReceiveSlot& slot);
+    void dispatchMessage(const boost::asio::ip::udp::endpoint& sender, std::string_view datagram);
+    void dispatchFrame(PeerId sender, Opcode opcode, std::string_view payload);
+    void sendMessage(Opcode opcode, std::string_view payload, const boost::asio::ip::udp::endpoint& target);
+    void queueMessage(Opcode opcode, std::string_view payload, PeerId target);
+    void flushOutboxes();
+    void transmit(std::shared_ptr<std::string> datagram, const boost::asio::ip::udp::endpoint& target, PeerId peer);
+    PeerId peerId(const boost::asio::ip::udp::endpoint& endpoint);
+    void restartPeerSession(PeerId peer);
+    void addConnectedPeer(PeerId peer);
+    void clearConnectedPeers();
+    void evictSilentPeers();
+    void notifyPeerLeft(PeerId peer);
+    void readmitPeer(PeerId peer);
+    void resendGameState(PeerId peer);
+    bool removePlayerEntry(const std::string& playerName, std::string& removed);
+    void refreshRoomView();
+    void scheduleStatsTick();
+    void sendPings();
+    void sendPing(PeerId peer);
+    void flushGameState();
+    void dumpStats();
+    std::uint32_t elapsedMs() const;
+    std::uint32_t matchTime() const;
+    std::string buildPlayerListMessage() const;
+
+    // Message handlers
+    void handleRoomAnnounce(PeerId sender, std::string_view payload);
+    void handleJoinRoomRequest(PeerId client, std::string_view payload);
+    void handlePlayerListUpdate(PeerId sender, std::string_view payload);
+    void handleEndpointList(PeerId sender, std::string_view payload);
+    void handleNewClient(PeerId sender, std::string_view payload);
+    void handleStartGame(PeerId sender, std::string_view payload);
+    void handleGameState(PeerId sender, std::string_view payload);
+    void handleInputs(PeerId sender, std::string_view payload);
+    void handlePing(PeerId sender, std::string_view payload);
+    void handlePong(PeerId sender, std::string_view payload);
+    void handleFragment(PeerId sender, std::string_view payload);
 
     // Private member variables
     bool gameSessionStarted = false;
-    bool gameStarted = false;
+    std::atomic<bool> gameStarted{false};
     boost::asio::io_context ioContext;
     boost::asio::ip::udp::socket socket;
-    boost::asio::ip::udp::endpoint senderEndpoint;
+    boost::asio::strand<boost::asio::io_context::executor_type> networkStrand;
+    ImpairedLink link;                                              // Every send goes through it, strand only
     boost::asio::ip::udp::endpoint hostEndpoint;
-    std::vector<char> buffer = std::vector<char>(1024);
-    std::vector<std::string> playerList;
-    std::vector<boost::asio::ip::udp::endpoint> connectedEndpoints;
+    boost::asio::ip::udp::endpoint selfEndpoint;
+    std::array<ReceiveSlot, RECEIVE_SLOTS> receiveSlots;
+    std::array<MessageHandler, 256> handlers{};
+    std::vector<std::string> playerList;                            // Guarded by playerListMutex
+    mutable std::mutex playerListMutex;
+
+    // Every endpoint we exchange packets with gets an id on first contact, for
+    // a joining client that is its JOIN_ROOM. The table only changes on the
+    // strand, under statsMutex so the UI thread can read it. A peer keeps its
+    // id after it left, so it gets the same one back when it returns; ids of
+    // peers outside the room are only reused once the table is full.
+    PeerTable peers;
+    std::vector<PeerId> connectedPeers;                             // Room members, only touched on the strand
+
+    // Liveness of every peer, strand only. Pings double as heartbeats, any
+    // packet counts as a sign of life.
+    struct Member {
+        bool connected = false;
+        bool evicted = false;                // Timed out, readmitted as soon as it is heard from again
+        std::uint32_t lastHeardMs = 0;
+        std::string playerName;              // Sent with JOIN_ROOM, so only the host knows it
+        std::string evictedEntry;            // Its player list entry when it timed out, ready mark included
+    };
+    static constexpr std::uint32_t PEER_TIMEOUT_MS = 5000;          // Five missed pings
+    std::vector<Member> members;                                    // Indexed by peer id
+
+    // Outgoing messages of the current tick, framed per peer, strand only
+    struct Outbox {
+        std::string frames;
+        std::size_t count = 0;
+    };
+    std::vector<Outbox> outboxes;                                   // Indexed by peer id
+    std::vector<PeerId> pendingOutboxes;                            // Peers with queued messages
+    bool flushScheduled = false;
+
+    // Messages larger than a datagram, strand only
+    std::uint16_t nextMessageId = 0;
+    FragmentReassembler reassembler;
 
     // Private member variables for callbacks
     std::function<void()> onGameStartCallback;
-    std::function<void(const std::string&, const std::string&)> notifyGameStateCallback;
+    std::function<void(PeerId, std::string_view)> notifyGameStateCallback;
+    std::function<void(PeerId, std::string_view)> notifyInputsCallback;
+    std::function<void(PeerId)> onPeerLeftCallback;
+
+    // Per peer statistics, written on the strand and copied out under the mutex
+    static constexpr std::chrono::seconds PING_INTERVAL{1};
+    static constexpr int STATS_DUMP_EVERY = 5; // In ping intervals
+    mutable std::mutex statsMutex;
+    std::vector<PeerStats> peerStats;                               // Indexed by peer id
+    LatencyHistogram frameTimes;
+    boost::asio::steady_timer statsTimer;
+    int statsTicks = 0;
+    std::ofstream statsFile;
+    const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    // Match clock, the estimate changes on the strand under statsMutex. A
+    // client pings the host back to back until the estimate is trusted.
+    static constexpr std::uint32_t START_LEAD_TICKS = 16;          // START_GAME is sent about 250 ms ahead
+    PeerId clockPeer = NO_PEER;                                     // The host, NO_PEER on the host itself
+    ClockSync clockSync;
+    std::atomic<std::uint32_t> startTick{0};
+
+    // Game state pacing, everything on the strand (peerSenders also under statsMutex)
+    struct PeerSender {
+        SendRateController rate;
+        bool statePending = false;          // latestState has not gone out to this peer yet
+        std::uint32_t reportedReceived = 0; // Counters from the peer's last PONG
+        std::uint32_t reportedLost = 0;
+    };
+    static constexpr std::chrono::milliseconds PACE_INTERVAL{10};
+    std::vector<PeerSender> peerSenders;                            // Indexed by peer id
+    std::string latestState;
+    boost::asio::steady_timer paceTimer;
+    bool paceTimerArmed = false;
+
+    // Join handshake, the UI thread waits until the host answered
+    static constexpr std::chrono::seconds JOIN_TIMEOUT{3};
+    std::mutex joinMutex;
+    std::condition_variable joinCondition;
+    bool joinPending = false;
 };
 
 
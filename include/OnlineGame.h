@@ -3,7 +3,11 @@
 
 #include "Game.h"
 #include "Network.h"
-#include <map>
+#include "RemotePlayerView.h"
+#include "Rollback.h"
+#include "TripleBuffer.h"
+#include <array>
+#include <atomic>
 
 class OnlineGame : public Game {
 public:
@@ -16,12 +20,67 @@ public:
     void render() override;
 
     void syncState();
-    void handleRemoteState(const std::string& playerId, const std::string& state);
+    void handleRemoteState(PeerId peer, std::string_view state);
+    void handleRemoteInputs(PeerId peer, std::string_view payload);
+
+    // Rollback mode: remote boards are simulated here from the players'
+    // inputs instead of drawn from their game states. Set before a game.
+    void setRollback(bool enabled) { rollback = enabled; }
+
+protected:
+    void handleExtraKey(SDL_Keycode key) override;
+    void renderOverlay() override;
 
 private:
+    static constexpr Uint32 STATE_SEND_INTERVAL_MS = 50; // Remote views interpolate between updates
+    static constexpr Uint32 NETWORK_ESTIMATE_INTERVAL_MS = 500;
+    static constexpr std::size_t MAX_REMOTE_PLAYERS = 8;
+    static constexpr std::int32_t MAX_CATCHUP_TICKS = 16;   // A longer stall is skipped, not replayed
+    static constexpr Uint32 MAX_START_WAIT_MS = 1000;       // In case the clock never synced
+
+    struct TimedSnapshot {
+        BoardSnapshot board;
+        Uint32 arrivalMs;
+    };
+
+    // The network thread claims a slot per player and publishes decoded boards
+    // into it, the render thread picks up the latest one every frame. When
+    // the player leaves, or a new game starts, the network thread releases
+    // the slot and the render thread clears it and hands it back as free.
+    enum class SlotState : std::uint8_t { Free, Active, Released };
+
+    struct RemoteSlot {
+        std::atomic<SlotState> state{SlotState::Free};
+        std::uint32_t generation = 0;         // Game it was claimed in; generation, peer and name are written before it is active
+        PeerId peer = NO_PEER;
+        std::array<char, 48> name{};
+        TripleBuffer<TimedSnapshot> latest;
+        TripleBuffer<InputWindow> inputs;
+        RemotePlayerView view;                // Render thread only
+        RollbackGame mirror;                  // Render thread only, in rollback mode
+    };
+
+    RemoteSlot* findRemoteSlot(PeerId peer);
+    void releaseRemoteSlot(PeerId peer);
+    void clearReleasedSlots();
+    bool isShown(const RemoteSlot& slot) const;
+    void waitForStart();
+    void sendInputs();
+    void advanceMirrors();
+
     Network* network;
-    std::map<std::string, std::string> playerStates;
+    std::array<RemoteSlot, MAX_REMOTE_PLAYERS> remoteSlots;
+    std::array<std::uint8_t, MAX_PEERS> slotOfPeer;    // Network thread only, MAX_REMOTE_PLAYERS if none
+    std::atomic<std::uint32_t> gameGeneration{0};      // Counts the games started, slots from earlier ones are let go
+    std::uint32_t claimGeneration = 0;                 // Network thread only, the game slotOfPeer is for
+    std::uint32_t tickBase = 0;                        // Match tick of our tick 0
+    Uint32 lastSyncTime = 0;
+    Uint32 lastEstimateTime = 0;
+    std::size_t inputsSent = 0;                        // Recorded inputs already sent
+    bool rollback = false;
+    bool showNetStats = false;
     void renderOtherPlayers(int x, int y, int width, int height);
+    void renderNetStats(int x, int y);
 };
 
 #endif // ONLINE_GAME_H
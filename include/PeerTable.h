@@ -0,0 +1,50 @@
+#ifndef PEER_TABLE_H
+#define PEER_TABLE_H
+
+#include <boost/asio.hpp>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Peers are known by a small integer id, which indexes every per-peer array
+using PeerId = std::uint16_t;
+constexpr PeerId NO_PEER = 0xFFFF;
+constexpr std::size_t MAX_PEERS = 256;
+
+// Maps endpoints to peer ids with open addressing and linear probing. The
+// table has twice as many slots as there can be peers, so probe chains stay
+// short and a lookup never allocates.
+class PeerTable {
+public:
+    PeerTable();
+
+    // NO_PEER if the endpoint has no id yet
+    PeerId find(const boost::asio::ip::udp::endpoint& endpoint) const;
+
+    // The id of the endpoint, given the lowest free one if it is new. NO_PEER when the table is full.
+    PeerId insert(const boost::asio::ip::udp::endpoint& endpoint);
+
+    // Frees the id for the next new endpoint
+    void erase(PeerId id);
+
+    const boost::asio::ip::udp::endpoint& endpoint(PeerId id) const { return endpoints[id]; }
+    bool contains(PeerId id) const { return id < MAX_PEERS && used[id]; }
+
+    // Every id in use is below limit()
+    std::size_t size() const { return count; }
+    std::size_t limit() const { return idLimit; }
+
+private:
+    static constexpr std::size_t SLOTS = MAX_PEERS * 2;
+    static_assert((SLOTS & (SLOTS - 1)) == 0, "the slot count must be a power of two");
+
+    static std::size_t hash(const boost::asio::ip::udp::endpoint& endpoint);
+
+    std::array<PeerId, SLOTS> slots;
+    std::array<boost::asio::ip::udp::endpoint, MAX_PEERS> endpoints;
+    std::array<bool, MAX_PEERS> used{};
+    std::size_t count = 0;
+    std::size_t idLimit = 0;
+};
+
+#endif // PEER_TABLE_H
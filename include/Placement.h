@@ -0,0 +1,64 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include "Block.h"
+#include "Grid.h"
+#include "Replay.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Where a piece comes to rest
+struct Placement {
+    std::int8_t x;
+    std::int8_t y;
+    std::uint8_t rotation;
+};
+
+// Finds every resting place a piece can be moved to with the inputs the
+// game accepts (left, right, down, rotate). The search runs on bitmasks:
+// one 64 bit word per row holds, for each of the four rotations, a 16 bit
+// lane with every x the piece fits at. With no input moving a piece up,
+// a single pass down the rows reaches everything: each row is filled from
+// the one above, then spread sideways and across rotations until it stops
+// growing. Gravity is left out, the inputs are assumed to come faster than
+// the piece falls.
+class PlacementFinder {
+public:
+    static constexpr std::size_t MAX_PLACEMENTS = 4 * Grid::MAX_WIDTH * Grid::MAX_HEIGHT;
+
+    // From where the piece is now, or from the spawn position. Rotations
+    // that give the same cells are only listed once.
+    std::size_t find(const Grid& grid, const Block& piece);
+    std::size_t find(const Grid& grid, BlockType type);
+
+    std::size_t size() const { return count; }
+    const Placement& operator[](std::size_t index) const { return placements[index]; }
+    const Placement* begin() const { return placements.data(); }
+    const Placement* end() const { return placements.data() + count; }
+
+    // The piece at that placement, to test or place it on a grid
+    Block blockAt(const Placement& placement, int color = 0) const;
+
+    // Shortest inputs from the start of the last search to the placement,
+    // found by a breadth first search over the same masks
+    std::vector<InputAction> pathTo(const Placement& placement) const;
+
+private:
+    static constexpr int PADDED_HEIGHT = Grid::MAX_HEIGHT + 12;  // Room for word reads past the bottom
+    using Rows = std::array<std::uint64_t, PADDED_HEIGHT>;       // Bit 16 * rotation + x per row
+
+    void computeFits(const Grid& grid);
+
+    BlockType type = I;
+    int height = 0;
+    Block start;
+    Rows fits{};                            // Where the piece fits, nowhere below the grid
+    Rows reached{};
+    std::array<int, 4> sameCellsAs{};       // First rotation with the same cells
+    std::array<Placement, MAX_PLACEMENTS> placements{};
+    std::size_t count = 0;
+};
+
+#endif // PLACEMENT_H
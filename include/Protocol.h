@@ -0,0 +1,118 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <boost/asio.hpp>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Wire protocol: every datagram starts with a one byte opcode and a 16 bit
+// per-destination sequence number (big endian), followed by the payload.
+// Messages queued for the same peer in one network tick travel together in
+// a Batch datagram, whose payload is a list of frames. A message too large
+// for one datagram is split into Fragment messages and rebuilt on arrival.
+enum class Opcode : std::uint8_t {
+    RoomAnnounce = 1,   // "Room hosted by <ip>", broadcast on the LAN
+    JoinRoom,           // name of the joining player
+    PlayerList,         // comma separated player names
+    EndpointList,       // comma separated "ip:port" entries
+    NewClient,          // "ip:port" of the client that just joined
+    StartGame,          // u32 match tick the game starts on
+    GameState,          // serialized board, see OnlineGame::syncState
+    Ping,               // u32 sender timestamp in ms
+    Pong,               // the timestamp of the ping, echoed back, then u32 packets in and lost from the pinger
+                        // and u32 match time of the ponger in ms
+    Batch,              // frames of [u8 opcode][u16 payload length][payload]
+    Fragment,           // [u16 message id][u8 index][u8 count][u8 opcode][part of the payload]
+    Inputs,             // recent inputs of the sender's game, see encodeInputWindow
+};
+
+constexpr std::size_t MESSAGE_HEADER_SIZE = 3;
+constexpr std::size_t FRAME_HEADER_SIZE = 3;
+constexpr std::size_t MAX_DATAGRAM_SIZE = 1200;  // Below the path MTU of Ethernet, Wi-Fi and common tunnels
+constexpr std::size_t FRAGMENT_HEADER_SIZE = 5;
+constexpr std::size_t MAX_FRAGMENTS = 64;        // Messages up to about 75 KB
+constexpr std::uint32_t MATCH_TICK_MS = 16;      // One tick of the shared match timeline, the game's fixed step
+
+// Largest payload that still fits in a datagram as a frame of a batch
+constexpr std::size_t MAX_UNFRAGMENTED_PAYLOAD = MAX_DATAGRAM_SIZE - MESSAGE_HEADER_SIZE - FRAME_HEADER_SIZE;
+constexpr std::size_t MAX_FRAGMENT_CHUNK = MAX_UNFRAGMENTED_PAYLOAD - FRAGMENT_HEADER_SIZE;
+
+// Build a datagram from an opcode and its payload, the sequence is filled in when it is sent
+std::string encodeMessage(Opcode opcode, std::string_view payload = {});
+void setMessageSequence(std::string& datagram, std::uint16_t sequence);
+
+// Split a datagram into its header and payload, false if it is too short
+bool decodeMessage(std::string_view datagram, Opcode& opcode, std::uint16_t& sequence, std::string_view& payload);
+
+// Append one framed message to the payload of a Batch datagram
+void appendFrame(std::string& out, Opcode opcode, std::string_view payload);
+
+// Big endian integer helpers for binary payloads
+void appendU16(std::string& out, std::uint16_t value);
+void appendU32(std::string& out, std::uint32_t value);
+void appendU64(std::string& out, std::uint64_t value);
+std::uint16_t readU16(const char* data);
+std::uint32_t readU32(const char* data);
+std::uint64_t readU64(const char* data);
+
+// Parse "a.b.c.d:port" without allocating, false on malformed input
+bool parseEndpoint(std::string_view text, boost::asio::ip::udp::endpoint& endpoint);
+
+// Format an endpoint as "ip:port"
+std::string formatEndpoint(const boost::asio::ip::udp::endpoint& endpoint);
+
+// Call onItem for every comma separated item of a payload
+template <typename Callback>
+void forEachListItem(std::string_view list, Callback onItem) {
+    while (!list.empty()) {
+        std::size_t comma = list.find(',');
+        onItem(list.substr(0, comma));
+        if (comma == std::string_view::npos) {
+            break;
+        }
+        list.remove_prefix(comma + 1);
+    }
+}
+
+// Call onFrame(opcode, payload) for every frame of a Batch payload, false if a frame is truncated
+template <typename Callback>
+bool forEachFrame(std::string_view frames, Callback onFrame) {
+    while (!frames.empty()) {
+        if (frames.size() < FRAME_HEADER_SIZE) {
+            return false;
+        }
+        auto opcode = static_cast<Opcode>(static_cast<std::uint8_t>(frames[0]));
+        std::size_t length = readU16(frames.data() + 1);
+        if (frames.size() - FRAME_HEADER_SIZE < length) {
+            return false;
+        }
+        onFrame(opcode, frames.substr(FRAME_HEADER_SIZE, length));
+        frames.remove_prefix(FRAME_HEADER_SIZE + length);
+    }
+    return true;
+}
+
+// Call onFragment(fragmentPayload) for every Fragment message a payload splits
+// into, false if it would take more than MAX_FRAGMENTS
+template <typename Callback>
+bool forEachFragment(Opcode opcode, std::string_view payload, std::uint16_t messageId, Callback onFragment) {
+    std::size_t count = (payload.size() + MAX_FRAGMENT_CHUNK - 1) / MAX_FRAGMENT_CHUNK;
+    if (count == 0 || count > MAX_FRAGMENTS) {
+        return false;
+    }
+    std::string fragment;
+    fragment.reserve(FRAGMENT_HEADER_SIZE + MAX_FRAGMENT_CHUNK);
+    for (std::size_t index = 0; index < count; ++index) {
+        fragment.clear();
+        appendU16(fragment, messageId);
+        fragment.push_back(static_cast<char>(index));
+        fragment.push_back(static_cast<char>(count));
+        fragment.push_back(static_cast<char>(opcode));
+        fragment.append(payload.substr(index * MAX_FRAGMENT_CHUNK, MAX_FRAGMENT_CHUNK));
+        onFragment(std::string_view(fragment));
+    }
+    return true;
+}
+
+#endif // PROTOCOL_H
@@ -0,0 +1,44 @@
+#ifndef RATE_CONTROL_H
+#define RATE_CONTROL_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Paces game state updates to one peer. A token bucket caps the bytes per
+// second and the rate itself is AIMD: it grows slowly while the peer reports
+// no loss and a steady RTT, and is cut when it reports loss or when the RTT
+// climbs well above the lowest one seen, which is the queue in front of a
+// busy Wi-Fi link filling up.
+class SendRateController {
+public:
+    static constexpr double MIN_RATE = 2000.0;            // Bytes per second, a few states per second
+    static constexpr double MAX_RATE = 32000.0;
+    static constexpr double INITIAL_RATE = 12000.0;
+    static constexpr double INCREASE_PER_SECOND = 2000.0;
+    static constexpr double DECREASE_FACTOR = 0.7;
+    static constexpr double LOSS_THRESHOLD = 0.02;
+    static constexpr double QUEUE_DELAY_THRESHOLD_MS = 80.0;
+    static constexpr double BURST_SECONDS = 0.1;
+
+    // Loss of our packets and RTT as last reported by the peer
+    void onFeedback(double lossRate, double rttMs, std::uint32_t nowMs);
+
+    // Takes the bytes from the bucket when there are enough of them
+    bool trySend(std::size_t bytes, std::uint32_t nowMs);
+
+    double rate() const { return rateBytes; }
+    bool backingOff() const { return lastDecreaseMs != 0 && lastFeedbackMs == lastDecreaseMs; }
+
+private:
+    void refill(std::uint32_t nowMs);
+
+    double rateBytes = INITIAL_RATE;
+    double tokens = 0.0;
+    double baseRttMs = 0.0;
+    bool started = false;
+    std::uint32_t lastRefillMs = 0;
+    std::uint32_t lastFeedbackMs = 0;
+    std::uint32_t lastDecreaseMs = 0;
+};
+
+#endif // RATE_CONTROL_H
@@ -0,0 +1,47 @@
+#ifndef REASSEMBLY_H
+#define REASSEMBLY_H
+
+#include <boost/asio.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Protocol.h"
+
+// Rebuilds messages that arrived as Fragment messages. Memory is bounded:
+// only a few messages are rebuilt at a time, each of at most MAX_FRAGMENTS
+// parts, and a message whose parts stop arriving is dropped after a while
+// or when a newer one needs its place.
+class FragmentReassembler {
+public:
+    static constexpr std::size_t MAX_PENDING = 8;      // Messages in progress, across all peers
+    static constexpr std::uint32_t TIMEOUT_MS = 2000;
+
+    // Takes the payload of one Fragment message. True once the message is
+    // complete, with its opcode and payload filled in.
+    bool add(const boost::asio::ip::udp::endpoint& sender, std::string_view fragment, std::uint32_t nowMs,
+             Opcode& opcode, std::string& message);
+
+    // Incomplete messages thrown away so far, timed out or evicted
+    std::size_t dropped() const { return droppedCount; }
+
+private:
+    struct Pending {
+        boost::asio::ip::udp::endpoint sender;
+        std::uint16_t messageId = 0;
+        Opcode opcode = Opcode::Fragment;
+        std::uint8_t count = 0;
+        std::uint64_t receivedMask = 0;  // Bit i is set once part i arrived
+        std::uint32_t startedMs = 0;
+        std::vector<std::string> parts;
+    };
+
+    Pending& findOrStart(const boost::asio::ip::udp::endpoint& sender, std::uint16_t messageId, std::uint32_t nowMs);
+    void expire(std::uint32_t nowMs);
+
+    std::vector<Pending> pending;
+    std::size_t droppedCount = 0;
+};
+
+#endif // REASSEMBLY_H
@@ -0,0 +1,69 @@
+#ifndef REMOTE_PLAYER_VIEW_H
+#define REMOTE_PLAYER_VIEW_H
+
+#include <SDL.h>
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+// Decoded game state of a remote player, plain data so it can be copied freely
+struct BoardSnapshot {
+    static constexpr int WIDTH = 10;
+    static constexpr int HEIGHT = 20;
+
+    std::uint32_t timeMs = 0;                     // Match clock when it was sent
+    std::uint32_t tick = 0;                       // Match tick of the sender's simulation
+    std::array<std::uint16_t, HEIGHT> rows{};     // Bit j set when column j is filled
+    std::array<std::uint8_t, 4> pieceRows{};      // Falling piece, same bit layout
+    int pieceWidth = 0;
+    int pieceHeight = 0;
+    int pieceType = 0;
+    int pieceColor = 0;
+    int pieceX = 0;
+    int pieceY = 0;
+    int score = 0;
+    unsigned int speed = 1000;                    // Gravity interval in ms
+
+    bool collides(int x, int y) const;
+};
+
+// Parse the text sent by OnlineGame::syncState: grid|block|score|speed|time|tick
+bool parseBoardSnapshot(std::string_view text, BoardSnapshot& snapshot);
+
+// Jitter buffer of timestamped snapshots for one remote player. Rendering
+// runs a little behind the newest snapshot so the falling piece can be
+// interpolated between two of them, and gravity is extrapolated for a
+// bounded time when packets are late.
+class RemotePlayerView {
+public:
+    static constexpr std::size_t BUFFER_SIZE = 16;
+    static constexpr Uint32 MIN_DELAY_MS = 20;
+    static constexpr Uint32 MAX_DELAY_MS = 300;
+    static constexpr Uint32 MAX_EXTRAPOLATION_MS = 250;
+
+    void push(const BoardSnapshot& snapshot, Uint32 arrivalMs);
+    void setNetworkEstimate(double rttMs, double jitterMs);
+
+    // Board to draw at nowMs, with the falling piece at a fractional position
+    bool sample(Uint32 nowMs, BoardSnapshot& board, float& pieceX, float& pieceY) const;
+
+    Uint32 getDelayMs() const { return delayMs; }
+    bool empty() const { return count == 0; }
+
+private:
+    const BoardSnapshot& at(std::size_t age) const; // 0 is the newest
+    void updateDelay();
+
+    std::array<BoardSnapshot, BUFFER_SIZE> snapshots{};
+    std::array<std::int64_t, BUFFER_SIZE> offsetsMs{};   // Arrival minus send time of each snapshot
+    std::size_t newest = 0;
+    std::size_t count = 0;
+
+    std::int64_t clockOffsetMs = 0;   // Smallest offset in the buffer, the fastest delivery plus any clock error left
+    double intervalMs = 50.0;         // Smoothed spacing between snapshots
+    double rttMs = 0.0;
+    double jitterMs = 0.0;
+    Uint32 delayMs = MIN_DELAY_MS;
+};
+
+#endif // REMOTE_PLAYER_VIEW_H
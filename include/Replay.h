@@ -0,0 +1,91 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <boost/endian/arithmetic.hpp>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Player actions, the only thing that feeds into the simulation besides the seed
+enum class InputAction : std::uint8_t {
+    Left,
+    Right,
+    Down,
+    Rotate,
+    Drop,       // Straight down to where it lands, and lock there
+};
+
+// Rules the game was played with, a replay only plays back under the same ones
+struct ReplaySettings {
+    std::uint32_t width = 10;
+    std::uint32_t height = 20;
+    std::uint32_t tickMs = 16;
+    std::uint32_t initialSpeed = 1000;
+    std::uint32_t minSpeed = 200;
+    std::uint32_t speedStep = 10;
+
+    bool operator==(const ReplaySettings& other) const = default;
+};
+
+struct ReplayEvent {
+    std::uint32_t tick;    // Applied before simulation tick + 1
+    InputAction action;
+};
+
+// Full game state at the end of a tick, enough to resume a replay from there.
+// Stored as is in replay archives, so every field has a fixed little endian layout.
+struct ReplayKeyframe {
+    static constexpr std::size_t CELLS = 10 * 20;
+
+    struct Piece {
+        std::uint8_t type;
+        std::uint8_t rotation;
+        std::uint8_t color;     // Palette index
+        std::int8_t x;
+        std::int8_t y;
+    };
+
+    boost::endian::little_uint32_t tick;
+    boost::endian::little_uint32_t eventIndex;   // Inputs already applied
+    boost::endian::little_uint64_t rngState;
+    boost::endian::little_uint32_t score;
+    boost::endian::little_uint32_t speed;
+    boost::endian::little_int32_t timer;
+    Piece current;
+    Piece next;
+    std::uint8_t gameOver;
+    std::array<std::uint8_t, CELLS> cells;       // Row major, 0 empty, else palette index + 1
+};
+
+// A recorded game. On disk:
+//   "TRPL" u8 version
+//   varint seed, varint x6 settings
+//   varint event count, then per event varint((tick delta << 3) | action)
+//   varint final tick, varint final score
+class Replay {
+public:
+    static constexpr std::uint8_t VERSION = 1;
+
+    std::uint64_t seed = 0;
+    ReplaySettings settings;
+    std::vector<ReplayEvent> events;
+    std::uint32_t finalTick = 0;
+    std::uint32_t finalScore = 0;
+
+    void clear();
+    void record(std::uint32_t tick, InputAction action) { events.push_back({tick, action}); }
+
+    std::string encode() const;
+    bool decode(std::string_view data);
+
+    bool save(const std::string& path) const;
+    bool load(const std::string& path);
+};
+
+// LEB128 varints used by the replay format
+void appendVarint(std::string& out, std::uint64_t value);
+bool readVarint(std::string_view& in, std::uint64_t& value);
+
+#endif // REPLAY_H
@@ -0,0 +1,81 @@
+#ifndef REPLAY_ARCHIVE_H
+#define REPLAY_ARCHIVE_H
+
+#include "Replay.h"
+#include <boost/endian/arithmetic.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Many replays in one file. Layout:
+//   ArchiveHeader, with the offsets of up to ARCHIVE_MAX_INDEX_BLOCKS index blocks
+//   records, each ReplayKeyframe x keyframeCount followed by the encoded replay
+//   index blocks of ARCHIVE_ENTRIES_PER_BLOCK ArchiveEntry, allocated as the archive grows
+// Appending writes the record and an index entry at the end of the file and
+// then bumps the count in the header, so a crash never leaves a broken entry.
+constexpr std::uint32_t ARCHIVE_VERSION = 1;
+constexpr std::uint32_t ARCHIVE_KEYFRAME_INTERVAL = 600;   // Ticks, about ten seconds of play
+constexpr std::uint32_t ARCHIVE_ENTRIES_PER_BLOCK = 1024;
+constexpr std::uint32_t ARCHIVE_MAX_INDEX_BLOCKS = 1024;
+
+struct ArchiveEntry {
+    boost::endian::little_uint64_t offset;
+    boost::endian::little_uint64_t seed;
+    boost::endian::little_uint32_t finalTick;
+    boost::endian::little_uint32_t finalScore;
+    boost::endian::little_uint32_t keyframeCount;
+    boost::endian::little_uint32_t replaySize;
+};
+
+struct ArchiveHeader {
+    char magic[4];
+    boost::endian::little_uint32_t version;
+    boost::endian::little_uint32_t keyframeInterval;
+    boost::endian::little_uint32_t replayCount;
+    boost::endian::little_uint32_t indexBlockCount;
+    boost::endian::little_uint64_t indexBlocks[ARCHIVE_MAX_INDEX_BLOCKS];
+};
+
+// Read side: maps the whole file and answers from it without copying
+class ReplayArchive {
+public:
+    bool open(const std::string& path);
+    void close();
+
+    std::size_t size() const { return count; }
+    std::uint32_t keyframeInterval() const;
+    const ArchiveEntry& entry(std::size_t index) const;
+
+    bool load(std::size_t index, Replay& replay) const;
+    // Latest keyframe at or before the tick, nullptr when the game has to start from the seed
+    const ReplayKeyframe* keyframeBefore(std::size_t index, std::uint32_t tick) const;
+
+private:
+    boost::interprocess::file_mapping file;
+    boost::interprocess::mapped_region region;
+    const char* data = nullptr;
+    std::size_t dataSize = 0;
+    std::size_t count = 0;
+
+    const ArchiveHeader& header() const;
+};
+
+// Write side: creates the archive if needed and appends to it
+class ReplayArchiveWriter {
+public:
+    bool open(const std::string& path);
+    bool append(const Replay& replay);
+    std::size_t size() const { return header.replayCount; }
+
+private:
+    std::fstream file;
+    ArchiveHeader header{};
+};
+
+// Re-simulates the replay and keeps the state every interval ticks
+std::vector<ReplayKeyframe> buildKeyframes(const Replay& replay, std::uint32_t interval);
+
+#endif // REPLAY_ARCHIVE_H
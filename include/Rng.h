@@ -0,0 +1,27 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <cstdint>
+
+// Small deterministic generator (splitmix64). The whole state is one
+// integer, so games can be replayed from their seed and copied freely.
+struct Rng {
+    std::uint64_t state = 0;
+
+    Rng() = default;
+    explicit Rng(std::uint64_t seed) : state(seed) {}
+
+    std::uint64_t next() {
+        std::uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in [0, bound)
+    int nextInt(int bound) {
+        return static_cast<int>((next() >> 32) * static_cast<std::uint64_t>(bound) >> 32);
+    }
+};
+
+#endif // RNG_H
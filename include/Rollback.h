@@ -0,0 +1,81 @@
+#ifndef ROLLBACK_H
+#define ROLLBACK_H
+
+#include "Game.h"
+#include "GameState.h"
+#include "Replay.h"
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// The newest inputs of one player's game, as carried by an INPUTS message.
+// Every message repeats the last few inputs, so a lost one is covered by
+// the next. Ticks are those of the sender's game, tickBase maps them onto
+// the match timeline.
+struct InputWindow {
+    static constexpr std::size_t MAX_INPUTS = 32;
+
+    std::uint64_t seed = 0;
+    std::uint32_t tickBase = 0;      // Match tick of the sender's tick 0
+    std::uint32_t ticksDone = 0;     // Every input before this tick is in the game's history
+    std::uint32_t firstIndex = 0;    // Position of events[0] in that history
+    std::uint32_t count = 0;
+    std::array<ReplayEvent, MAX_INPUTS> events{};
+};
+
+// [u64 seed][u32 tick base][u32 ticks done][u32 first index][u8 count] then [u32 tick][u8 action] per input
+std::string encodeInputWindow(const InputWindow& window);
+bool parseInputWindow(std::string_view payload, InputWindow& window);
+
+// The last inputs of a recording, for the INPUTS message of a local game
+InputWindow makeInputWindow(const Replay& recording, std::uint32_t tickBase, std::uint32_t ticksDone);
+
+// Mirror of a remote player's game, simulated here from its seed and its
+// inputs. It runs ahead of the inputs on the guess that nothing was
+// pressed, so the board moves without waiting for the network. When inputs
+// arrive for ticks already simulated, it restores the saved state of the
+// first one and simulates forward again, all within one frame.
+class RollbackGame {
+public:
+    static constexpr std::uint32_t HISTORY_TICKS = 128;       // Saved states, about 2 s to roll back into
+    static constexpr std::uint32_t MAX_PREDICTION_TICKS = 32; // Ahead of the last tick the inputs covered
+
+    RollbackGame();
+    RollbackGame(const RollbackGame&) = delete;            // The simulation points at our inputs
+    RollbackGame& operator=(const RollbackGame&) = delete;
+
+    // False when inputs were missed for good, the game can not be mirrored any more
+    bool addInputs(const InputWindow& window);
+
+    // Simulate up to this tick of the remote game, rolling back first if needed
+    void advanceTo(std::uint32_t targetTick);
+
+    bool active() const { return started && !broken; }
+    void reset() { started = false; broken = false; }     // The next inputs start a new game
+    std::uint32_t getTickBase() const { return tickBase; }
+    const Game& game() const { return simulation; }
+
+    std::uint64_t rollbacks() const { return rollbackCount; }
+    std::uint32_t deepestRollback() const { return deepestTicks; }
+    std::uint64_t fullResimulations() const { return resimulationCount; }
+
+private:
+    static constexpr std::uint32_t NO_TICK = 0xFFFFFFFF;
+
+    void saveState();
+
+    Game simulation;
+    Replay inputs;                                          // Everything the remote player pressed so far
+    GameStateRing<HISTORY_TICKS> history;                   // State at the end of each recent tick
+    bool started = false;
+    bool broken = false;
+    std::uint32_t tickBase = 0;
+    std::uint32_t ticksDone = 0;
+    std::uint32_t rollbackFrom = NO_TICK;                   // Earliest tick simulated without an input it had
+    std::uint64_t rollbackCount = 0;
+    std::uint32_t deepestTicks = 0;
+    std::uint64_t resimulationCount = 0;
+};
+
+#endif // ROLLBACK_H
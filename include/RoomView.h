@@ -4,6 +4,8 @@
 #include <vector>
 #include <string>
 #include <functional>
+#include <atomic>
+#include <mutex>
 #include "Button.h"
 #include <SDL.h>
 
@@ -26,12 +28,13 @@ public:
     void quitRendering();
     
 private:
-    bool quit;
+    std::atomic<bool> quit{false};
     SDL_Renderer* renderer;
     bool isHost;
     bool isReady = false;
     size_t selectedButtonIndex;
-    std::vector<std::string> players;
+    std::vector<std::string> players; // Updated from the network thread
+    std::mutex playersMutex;
     std::vector<Button> buttons;
     bool isRendered = false;
     void renderPlayers();
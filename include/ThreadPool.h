@@ -0,0 +1,57 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work stealing pool. Every worker owns a deque: it takes its own work from
+// the back and, once that runs dry, steals from the front of the others.
+// Tasks submitted from a worker go to its own deque, tasks from outside are
+// spread round robin, so uneven tasks still keep every core busy.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threadCount = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(std::function<void()> task);
+    // Blocks until every submitted task has finished, helping in the meantime
+    void wait();
+
+    unsigned size() const { return static_cast<unsigned>(workers.size()); }
+    std::size_t stealCount() const { return steals.load(std::memory_order_relaxed); }
+    // Index of the calling thread among this pool's workers, -1 on any other
+    // thread, including the workers of another pool
+    int currentWorker() const;
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool runOne(int self);
+    void workerLoop(int self);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    std::atomic<std::size_t> queued{0};      // In some deque
+    std::atomic<std::size_t> unfinished{0};  // Submitted and not done yet
+    std::atomic<std::size_t> steals{0};
+    std::atomic<unsigned> nextWorker{0};
+    std::atomic<bool> stopping{false};
+    std::mutex sleepMutex;
+    std::condition_variable workAvailable;
+    std::condition_variable allDone;
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,52 @@
+#ifndef TRANSPOSITION_TABLE_H
+#define TRANSPOSITION_TABLE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Scores of boards a search has already seen, keyed by their hash, shared
+// by the search threads without locks. An entry is two words: the score,
+// and the key XORed with the score in the high 48 bits. Another thread can
+// overwrite one word between the two reads, that pair then fails the check
+// and reads as a miss, never as a wrong score. The low 16 bits of the
+// check word say which search stored the entry and how deep, so a full
+// bucket gives up entries of earlier searches first, then shallow ones.
+// The bucket index covers the low bits of the key.
+class TranspositionTable {
+public:
+    static constexpr int BUCKET_SIZE = 4;   // Entries per 64 byte bucket
+
+    explicit TranspositionTable(std::size_t entries = std::size_t{1} << 14);
+
+    TranspositionTable(const TranspositionTable&) = delete;
+    TranspositionTable& operator=(const TranspositionTable&) = delete;
+
+    bool find(std::uint64_t key, double& score) const;
+    void store(std::uint64_t key, double score, int depth);
+
+    // Entries of earlier searches stay valid, they are only replaced first
+    void newSearch();
+    void clear();
+
+    std::size_t size() const { return bucketCount * BUCKET_SIZE; }
+
+private:
+    struct Entry {
+        std::atomic<std::uint64_t> check{0};
+        std::atomic<std::uint64_t> score{0};
+    };
+    struct alignas(64) Bucket {
+        std::array<Entry, BUCKET_SIZE> entries;
+    };
+
+    Bucket& bucketOf(std::uint64_t key) const { return buckets[key & (bucketCount - 1)]; }
+
+    std::unique_ptr<Bucket[]> buckets;
+    std::size_t bucketCount;
+    std::uint8_t generation = 1;    // Never 0, an empty entry has 0
+};
+
+#endif // TRANSPOSITION_TABLE_H
@@ -0,0 +1,47 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+// Hands the latest value from one writer thread to one reader thread.
+// The writer fills its private back buffer and swaps it with the middle
+// one, the reader swaps the middle one out when it holds something new.
+// Neither side waits, locks or allocates, and the reader always sees a
+// complete value.
+template <typename T>
+class TripleBuffer {
+    static_assert(std::is_trivially_copyable_v<T>, "TripleBuffer needs a trivially copyable type");
+
+public:
+    // Writer side
+    T& writeBuffer() { return buffers[backIndex]; }
+
+    void publish() {
+        backIndex = middle.exchange(static_cast<std::uint8_t>(backIndex | FRESH), std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // Reader side, true when a newer value was published since the last call
+    bool update() {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH)) {
+            return false;
+        }
+        frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    const T& latest() const { return buffers[frontIndex]; }
+
+private:
+    static constexpr std::uint8_t FRESH = 0x4;
+    static constexpr std::uint8_t INDEX_MASK = 0x3;
+
+    std::array<T, 3> buffers{};
+    std::atomic<std::uint8_t> middle{1};
+    std::uint8_t backIndex = 0;   // Owned by the writer
+    std::uint8_t frontIndex = 2;  // Owned by the reader
+};
+
+#endif // TRIPLE_BUFFER_H
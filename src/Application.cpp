@@ -1,4 +1,6 @@
 #include "Application.h"
+#include "Bot.h"
+#include "ReplayArchive.h"
 #include <SDL.h>
 #include <ctime>
 #include <iomanip>
@@ -131,13 +133,58 @@ void Application::run() {
     }
 }
 
+// Every datagram this player sends goes through the simulated link
+void Application::setNetworkImpairment(const ImpairmentSettings& settings) {
+    network.setImpairment(settings);
+}
+
+void Application::setRollback(bool enabled) {
+    onlineGame->setRollback(enabled);
+}
+
+// Both the practice game and the online one, a bot client fills a seat in a
+// room. A searching bot looks ahead through the preview on every core.
+void Application::setBot(bool enabled, bool search) {
+    for (Game* target : {game, static_cast<Game*>(onlineGame)}) {
+        std::unique_ptr<Bot> bot;
+        if (enabled) {
+            bot = std::make_unique<Bot>();
+            if (search) {
+                bot->setSearch(std::make_unique<BeamSearch>());
+            }
+        }
+        target->setBot(std::move(bot));
+    }
+}
+
+// Started with --replay instead of the menu. Archives jump to the
+// requested game and tick through the nearest keyframe.
+void Application::playReplay(const std::string& path, bool realtime, std::size_t gameIndex, std::uint32_t startTick) {
+    Replay replay;
+    ReplayArchive archive;
+    const ReplayKeyframe* keyframe = nullptr;
+    if (archive.open(path)) {
+        if (!archive.load(gameIndex, replay)) {
+            log("No game " + std::to_string(gameIndex) + " in replay archive " + path);
+            return;
+        }
+        keyframe = archive.keyframeBefore(gameIndex, startTick);
+    } else if (!replay.load(path)) {
+        log("Failed to load replay: " + path);
+        return;
+    }
+    log("Playing replay " + path + " (" + std::to_string(replay.events.size()) + " inputs, " +
+        std::to_string(replay.finalTick) + " ticks)");
+    game->showReplay(replay, realtime, keyframe, startTick);
+}
+
 void Application::createRoom() {
     // Room setup
     network.initializeRoomView(renderer, true, "Host");
     int roomPort = 12345;
     int destPort = 54321;
-    network.initializeEndPoints();
     network.startListening(roomPort);
+    network.initializeEndPoints();
     log("Room created and listening started on port " + std::to_string(roomPort));
 
     // Broadcast room info
@@ -162,8 +209,7 @@ void Application::createRoom() {
 
     network.stopListening();
 
-    delete network.roomView;
-    network.roomView = nullptr;
+    network.releaseRoomView();
 }
 
 void Application::joinRoom() {
@@ -225,17 +271,21 @@ void Application::handleRoomSelection(const std::string& roomInfo) {
     }
     
     int hostPort = 12345;
-    network.joinRoom(hostAddress, hostPort);
+    std::string playerName = "Guest Player";
+    network.joinRoom(hostAddress, hostPort, playerName);
 
     // Renew the player list
     for (const auto& player : network.getPlayerList()) {
         network.roomView->addPlayer(player);
     }
-    std::string playerName = "Guest Player";
     network.addPlayer(playerName);
     network.roomView->addPlayer(playerName);
     log("Switched to RoomView rendering with updated player list.");
-    network.roomView->render();
+
+    // Rejoining a game that is already running skips the room
+    if (!startTogether) {
+        network.roomView->render();
+    }
 
     // Game start
     if(startTogether) {
@@ -243,6 +293,5 @@ void Application::handleRoomSelection(const std::string& roomInfo) {
         startTogether = false;
     }
 
-    delete network.roomView;
-    network.roomView = nullptr;
+    network.releaseRoomView();
 }
\ No newline at end of file
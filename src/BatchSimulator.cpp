@@ -0,0 +1,386 @@
+#include "BatchSimulator.h"
+#include <algorithm>
+#include <cstdlib>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BATCH_AVX2 1
+#include <immintrin.h>
+#endif
+
+// The kernels work on one group of 16 games: rows and piece point at the
+// group's first game, a row of the next game is stride masks further on.
+
+// Moves every piece steps[g] columns, to the right for games in right and
+// to the left for the others, one column at a time like the arrow keys. A
+// piece stops at a wall or at the first cell in its way, steps is left
+// with the columns it did not move. rows is the spawn row.
+static void slideScalar(const std::uint16_t* rows, std::uint16_t* piece, std::size_t stride,
+                        std::uint16_t rightWall, std::uint32_t right, std::uint16_t* steps) {
+    for (int g = 0; g < BatchSimulator::GROUP; ++g) {
+        bool toRight = (right >> g) & 1;
+        for (; steps[g]; --steps[g]) {
+            std::uint16_t moved[4];
+            std::uint16_t blocked = 0;
+            for (int i = 0; i < 4; ++i) {
+                std::uint16_t cells = piece[i * stride + g];
+                moved[i] = static_cast<std::uint16_t>(toRight ? cells << 1 : cells >> 1);
+                blocked |= (cells & (toRight ? rightWall : 1)) | (moved[i] & rows[i * stride + g]);
+            }
+            if (blocked) {
+                break;
+            }
+            for (int i = 0; i < 4; ++i) {
+                piece[i * stride + g] = moved[i];
+            }
+        }
+    }
+}
+
+// Lowers every piece from the spawn row until the row below blocks it.
+// Games in done are already over and have no piece.
+static void dropScalar(const std::uint16_t* rows, const std::uint16_t* piece, std::size_t stride,
+                       std::uint32_t done, std::uint16_t* landing) {
+    for (int y = 0; done != 0xFFFF; ++y) {
+        for (int g = 0; g < BatchSimulator::GROUP; ++g) {
+            if ((done >> g) & 1) {
+                continue;
+            }
+            std::uint16_t hit = 0;
+            for (int i = 0; i < 4; ++i) {
+                hit |= rows[(y + 1 + i) * stride + g] & piece[i * stride + g];
+            }
+            if (hit) {
+                landing[g] = static_cast<std::uint16_t>(y);
+                done |= 1u << g;
+            }
+        }
+    }
+}
+
+static void lockScalar(std::uint16_t* rows, const std::uint16_t* piece, std::size_t stride,
+                       const std::uint16_t* landing) {
+    for (int g = 0; g < BatchSimulator::GROUP; ++g) {
+        for (int i = 0; i < 4; ++i) {
+            rows[(landing[g] + i) * stride + g] |= piece[i * stride + g];
+        }
+    }
+}
+
+static std::uint32_t fullScalar(const std::uint16_t* row, std::uint16_t full) {
+    std::uint32_t lanes = 0;
+    for (int g = 0; g < BatchSimulator::GROUP; ++g) {
+        lanes |= static_cast<std::uint32_t>(row[g] == full) << g;
+    }
+    return lanes;
+}
+
+#ifdef BATCH_AVX2
+// One bit per 16 bit lane that is all ones
+__attribute__((target("avx2"))) static std::uint32_t laneBits(__m256i lanes) {
+    __m256i bytes = _mm256_permute4x64_epi64(_mm256_packs_epi16(lanes, lanes), 0xD8);
+    return static_cast<std::uint32_t>(_mm256_movemask_epi8(bytes)) & 0xFFFF;
+}
+
+__attribute__((target("avx2"))) static __m256i load(const std::uint16_t* masks) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(masks));
+}
+
+// All ones in the lanes whose bit is set
+__attribute__((target("avx2"))) static __m256i bitLanes(std::uint32_t bits) {
+    const __m256i lanes = _mm256_setr_epi16(0x1, 0x2, 0x4, 0x8, 0x10, 0x20, 0x40, 0x80, 0x100, 0x200, 0x400,
+                                            0x800, 0x1000, 0x2000, 0x4000, static_cast<short>(0x8000));
+    return _mm256_cmpeq_epi16(_mm256_and_si256(_mm256_set1_epi16(static_cast<short>(bits)), lanes), lanes);
+}
+
+__attribute__((target("avx2"))) static void slideAvx2(const std::uint16_t* rows, std::uint16_t* piece,
+                                                      std::size_t stride, std::uint16_t rightWall,
+                                                      std::uint32_t right, std::uint16_t* steps) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i toRight = bitLanes(right);
+    const __m256i edge = _mm256_blendv_epi8(_mm256_set1_epi16(1), _mm256_set1_epi16(static_cast<short>(rightWall)), toRight);
+    __m256i cells[4];
+    __m256i spawnRows[4];
+    for (int i = 0; i < 4; ++i) {
+        cells[i] = load(piece + i * stride);
+        spawnRows[i] = load(rows + i * stride);
+    }
+    __m256i left = load(steps);
+    __m256i moving = _mm256_andnot_si256(_mm256_cmpeq_epi16(left, zero), _mm256_cmpeq_epi16(zero, zero));
+    while (!_mm256_testz_si256(moving, moving)) {
+        __m256i moved[4];
+        __m256i blocked = zero;
+        for (int i = 0; i < 4; ++i) {
+            moved[i] = _mm256_blendv_epi8(_mm256_srli_epi16(cells[i], 1), _mm256_slli_epi16(cells[i], 1), toRight);
+            blocked = _mm256_or_si256(blocked, _mm256_or_si256(_mm256_and_si256(cells[i], edge),
+                                                               _mm256_and_si256(moved[i], spawnRows[i])));
+        }
+        __m256i free = _mm256_and_si256(_mm256_cmpeq_epi16(blocked, zero), moving);
+        for (int i = 0; i < 4; ++i) {
+            cells[i] = _mm256_blendv_epi8(cells[i], moved[i], free);
+        }
+        left = _mm256_add_epi16(left, free);    // Lanes that moved are all ones, minus one
+        moving = _mm256_andnot_si256(_mm256_cmpeq_epi16(left, zero), free);
+    }
+    for (int i = 0; i < 4; ++i) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(piece + i * stride), cells[i]);
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(steps), left);
+}
+
+__attribute__((target("avx2"))) static void dropAvx2(const std::uint16_t* rows, const std::uint16_t* piece,
+                                                     std::size_t stride, std::uint32_t done,
+                                                     std::uint16_t* landing) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i cells[4];
+    for (int i = 0; i < 4; ++i) {
+        cells[i] = load(piece + i * stride);
+    }
+    __m256i pending = bitLanes(~done & 0xFFFF);
+    __m256i landed = zero;
+    for (int y = 0; !_mm256_testz_si256(pending, pending); ++y) {
+        const std::uint16_t* below = rows + (y + 1) * stride;
+        __m256i hit = _mm256_or_si256(
+            _mm256_or_si256(_mm256_and_si256(load(below), cells[0]), _mm256_and_si256(load(below + stride), cells[1])),
+            _mm256_or_si256(_mm256_and_si256(load(below + 2 * stride), cells[2]),
+                            _mm256_and_si256(load(below + 3 * stride), cells[3])));
+        __m256i stopped = _mm256_andnot_si256(_mm256_cmpeq_epi16(hit, zero), pending);
+        landed = _mm256_or_si256(landed, _mm256_and_si256(stopped, _mm256_set1_epi16(static_cast<short>(y))));
+        pending = _mm256_andnot_si256(stopped, pending);
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(landing), landed);
+}
+
+// Every row from top to bottom gets the piece row whose offset from the
+// landing row matches, the others add nothing
+__attribute__((target("avx2"))) static void lockAvx2(std::uint16_t* rows, const std::uint16_t* piece,
+                                                     std::size_t stride, const std::uint16_t* landing,
+                                                     int top, int bottom) {
+    __m256i landed = load(landing);
+    __m256i cells[4];
+    for (int i = 0; i < 4; ++i) {
+        cells[i] = load(piece + i * stride);
+    }
+    for (int y = top; y <= bottom; ++y) {
+        __m256i offset = _mm256_sub_epi16(_mm256_set1_epi16(static_cast<short>(y)), landed);
+        __m256i row = load(rows + y * stride);
+        for (int i = 0; i < 4; ++i) {
+            row = _mm256_or_si256(row, _mm256_and_si256(cells[i], _mm256_cmpeq_epi16(offset, _mm256_set1_epi16(static_cast<short>(i)))));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(rows + y * stride), row);
+    }
+}
+
+__attribute__((target("avx2"))) static std::uint32_t fullAvx2(const std::uint16_t* row, std::uint16_t full) {
+    return laneBits(_mm256_cmpeq_epi16(load(row), _mm256_set1_epi16(static_cast<short>(full))));
+}
+#endif
+
+BatchSimulator::BatchSimulator(std::size_t games, int width, int height)
+    : games(games),
+      stride((games + GROUP - 1) / GROUP * GROUP),
+      width(std::clamp(width, 4, Grid::MAX_WIDTH)),
+      height(std::clamp(height, 4, Grid::MAX_HEIGHT)),
+      fullRow(static_cast<std::uint16_t>((1u << this->width) - 1)),
+      avx2(false),
+      rows((static_cast<std::size_t>(this->height) + PIECE_ROWS) * stride),
+      piece(PIECE_ROWS * stride),
+      landing(stride),
+      current(stride),
+      next(stride),
+      rotation(stride),
+      column(stride),
+      rngs(stride),
+      scores(stride),
+      placements(stride),
+      gameOver(stride, 1) {
+    useAvx2(true);
+    // Below the bottom everything is filled, the drop stops on it
+    std::fill(rows.begin() + static_cast<std::ptrdiff_t>(this->height * stride), rows.end(), 0xFFFF);
+    resetAll(0);
+}
+
+void BatchSimulator::useAvx2(bool enabled) {
+#ifdef BATCH_AVX2
+    avx2 = enabled && __builtin_cpu_supports("avx2");
+#else
+    (void)enabled;
+#endif
+}
+
+void BatchSimulator::reset(std::size_t game, std::uint64_t seed) {
+    for (int y = 0; y < height; ++y) {
+        rows[y * stride + game] = 0;
+    }
+    rngs[game] = Rng(seed);
+    current[game] = static_cast<std::uint8_t>(Block(rngs[game]).getType());  // Draws as many numbers as Game
+    next[game] = static_cast<std::uint8_t>(Block(rngs[game]).getType());
+    rotation[game] = 0;
+    column[game] = Block::SPAWN_X;
+    scores[game] = 0;
+    placements[game] = 0;
+    gameOver[game] = 0;
+}
+
+void BatchSimulator::resetAll(std::uint64_t firstSeed) {
+    for (std::size_t game = 0; game < games; ++game) {
+        reset(game, firstSeed + game);
+    }
+}
+
+std::uint16_t BatchSimulator::getRow(std::size_t game, int y) const {
+    return rows[y * stride + game];
+}
+
+Grid BatchSimulator::getGrid(std::size_t game) const {
+    Grid grid(width, height);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            if ((getRow(game, y) >> x) & 1) {
+                grid.setCell(x, y, basicColor(0));
+            }
+        }
+    }
+    return grid;
+}
+
+// The same test as Grid::canPlace at the spawn row
+bool BatchSimulator::fitsAtSpawn(std::size_t game, int turns, int x) const {
+    const BlockShape& cells = Block::shapeOf(static_cast<BlockType>(current[game]), turns);
+    if (x < 0 || x + cells.width > width) {
+        return false;
+    }
+    for (int i = 0; i < cells.height; ++i) {
+        if (rows[(Block::SPAWN_Y + i) * stride + game] & (cells.rows[i] << x)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void BatchSimulator::buildPiece(std::size_t game, int turns, int x) {
+    const BlockShape& cells = Block::shapeOf(static_cast<BlockType>(current[game]), turns);
+    for (int i = 0; i < PIECE_ROWS; ++i) {
+        piece[i * stride + game] = i < cells.height ? static_cast<std::uint16_t>(cells.rows[i] << x) : 0;
+    }
+}
+
+void BatchSimulator::clearFullRows(std::size_t game, int top, int bottom) {
+    int to = bottom;
+    for (int from = bottom; from >= 0; --from) {
+        std::uint16_t row = rows[from * stride + game];
+        if (from >= top && row == fullRow) {
+            scores[game] += 100;
+            continue;
+        }
+        rows[to-- * stride + game] = row;
+    }
+    for (; to >= 0; --to) {
+        rows[to * stride + game] = 0;
+    }
+}
+
+void BatchSimulator::spawn(std::size_t game) {
+    current[game] = next[game];
+    next[game] = static_cast<std::uint8_t>(Block(rngs[game]).getType());
+    rotation[game] = 0;
+    column[game] = Block::SPAWN_X;
+    if (!fitsAtSpawn(game, 0, Block::SPAWN_X)) {
+        gameOver[game] = 1;
+    }
+}
+
+void BatchSimulator::step(const std::vector<BatchAction>& actions) {
+    const std::uint16_t rightWall = static_cast<std::uint16_t>(1u << (width - 1));  // The last column
+    for (std::size_t first = 0; first < stride; first += GROUP) {
+        // Turns and moves as single inputs, each one refused when it does not
+        // fit. The turns need the shape table and are tried game by game.
+        std::uint32_t done = 0;
+        std::uint32_t right = 0;
+        std::uint16_t steps[GROUP] = {};
+        for (int g = 0; g < GROUP; ++g) {
+            std::size_t game = first + static_cast<std::size_t>(g);
+            if (game >= games || gameOver[game]) {
+                done |= 1u << g;
+                for (int i = 0; i < PIECE_ROWS; ++i) {
+                    piece[i * stride + game] = 0;
+                }
+                continue;
+            }
+            const BatchAction& action = actions[game];
+            int turns = rotation[game];
+            for (int turn = 0; turn < (action.rotation & 3) && fitsAtSpawn(game, (turns + 1) & 3, column[game]); ++turn) {
+                turns = (turns + 1) & 3;
+            }
+            rotation[game] = static_cast<std::uint8_t>(turns);
+            buildPiece(game, turns, column[game]);
+            right |= static_cast<std::uint32_t>(action.x > column[game]) << g;
+            steps[g] = static_cast<std::uint16_t>(std::abs(action.x - column[game]));
+        }
+        if (done == 0xFFFF) {
+            continue;
+        }
+
+        std::uint16_t* groupRows = rows.data() + first;
+        std::uint16_t* groupPiece = piece.data() + first;
+        std::uint16_t wanted[GROUP];
+        std::copy(steps, steps + GROUP, wanted);
+        const std::uint16_t* spawnRows = groupRows + Block::SPAWN_Y * stride;
+#ifdef BATCH_AVX2
+        if (avx2) {
+            slideAvx2(spawnRows, groupPiece, stride, rightWall, right, steps);
+        } else
+#endif
+            slideScalar(spawnRows, groupPiece, stride, rightWall, right, steps);
+        for (int g = 0; g < GROUP; ++g) {
+            int moved = wanted[g] - steps[g];
+            column[first + g] = static_cast<std::int8_t>(column[first + g] + ((right >> g) & 1 ? moved : -moved));
+        }
+
+        std::uint16_t* groupLanding = landing.data() + first;
+#ifdef BATCH_AVX2
+        if (avx2) {
+            dropAvx2(groupRows, groupPiece, stride, done, groupLanding);
+        } else
+#endif
+            dropScalar(groupRows, groupPiece, stride, done, groupLanding);
+
+        // The rows the pieces cover, the only ones that can become full
+        int top = height;
+        int bottom = 0;
+        for (int g = 0; g < GROUP; ++g) {
+            if (!((done >> g) & 1)) {
+                top = std::min(top, static_cast<int>(groupLanding[g]));
+                bottom = std::max(bottom, groupLanding[g] + PIECE_ROWS - 1);
+            }
+        }
+        bottom = std::min(bottom, height - 1);
+#ifdef BATCH_AVX2
+        if (avx2) {
+            lockAvx2(groupRows, groupPiece, stride, groupLanding, top, bottom);
+        } else
+#endif
+            lockScalar(groupRows, groupPiece, stride, groupLanding);
+
+        std::uint32_t cleared = 0;
+        for (int y = top; y <= bottom; ++y) {
+#ifdef BATCH_AVX2
+            cleared |= avx2 ? fullAvx2(groupRows + y * stride, fullRow) : fullScalar(groupRows + y * stride, fullRow);
+#else
+            cleared |= fullScalar(groupRows + y * stride, fullRow);
+#endif
+        }
+        cleared &= ~done;
+
+        for (int g = 0; g < GROUP; ++g) {
+            std::size_t game = first + static_cast<std::size_t>(g);
+            if ((done >> g) & 1) {
+                continue;
+            }
+            if ((cleared >> g) & 1) {
+                clearFullRows(game, groupLanding[g], std::min(groupLanding[g] + PIECE_ROWS - 1, height - 1));
+            }
+            ++placements[game];
+            spawn(game);
+        }
+    }
+}
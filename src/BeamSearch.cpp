@@ -0,0 +1,214 @@
+#include "BeamSearch.h"
+#include <algorithm>
+
+// Marks the key of a board's average over the next piece apart from the
+// key of its own score
+static constexpr std::uint64_t AVERAGE_KEY = 0x6A09E667F3BCC909ull;
+
+BeamSearch::BeamSearch(const SearchSettings& settings)
+    : settings(settings), pool(std::max(settings.threads, 1u)), table(settings.tableEntries) {
+    for (unsigned i = 0; i <= pool.size(); ++i) {
+        arenas.push_back(std::make_unique<Arena>());
+    }
+    boardWeights.linesCleared = 0;
+}
+
+BeamSearch::Arena& BeamSearch::arena() {
+    int worker = pool.currentWorker();
+    return *arenas[worker >= 0 ? static_cast<std::size_t>(worker) : arenas.size() - 1];
+}
+
+// Checked before each board, the clock is not read while scoring
+bool BeamSearch::pastDeadline() {
+    if (!outOfTime.load(std::memory_order_relaxed) && std::chrono::steady_clock::now() >= deadline) {
+        outOfTime.store(true, std::memory_order_relaxed);
+    }
+    return outOfTime.load(std::memory_order_relaxed);
+}
+
+// Score of the board the piece leaves, lines not counted. Cached and
+// computed values are the same doubles, so a hit never changes the result.
+double BeamSearch::boardValue(Arena& own, const Grid& grid, const Block& piece, std::uint64_t hash, int depth) {
+    double value;
+    if (table.find(hash, value)) {
+        ++own.cacheHits;
+        return value;
+    }
+    value = scorePlacement(grid, piece, boardWeights);
+    table.store(hash, value, depth);
+    return value;
+}
+
+void BeamSearch::expand(Arena& own, int parent, const Block& piece, int depth) {
+    const Node& node = beam[static_cast<std::size_t>(parent)];
+    own.finder.find(node.grid, piece);
+    for (const Placement& placement : own.finder) {
+        Block placed = own.finder.blockAt(placement);
+        int lines;
+        std::uint64_t hash = node.grid.hashAfter(placed, lines);
+        double score = boardValue(own, node.grid, placed, hash, depth) + lineScore * (node.lines + lines);
+        own.candidates.push_back({score, parent, placement, hash, lines});
+    }
+    own.evaluated += own.finder.size();
+}
+
+// What a board is worth when any piece can come next: the best placement
+// of each piece, averaged
+double BeamSearch::averageOverPieces(Arena& own, const Node& node, int depth) {
+    std::uint64_t key = node.grid.getHash() ^ AVERAGE_KEY;
+    double average;
+    if (table.find(key, average)) {
+        ++own.cacheHits;
+        return average + lineScore * node.lines;
+    }
+    double sum = 0;
+    for (int type = 0; type < 7; ++type) {
+        double best = GAME_OVER_SCORE;
+        own.finder.find(node.grid, static_cast<BlockType>(type));
+        for (const Placement& placement : own.finder) {
+            Block placed = own.finder.blockAt(placement);
+            int lines;
+            std::uint64_t hash = node.grid.hashAfter(placed, lines);
+            best = std::max(best, boardValue(own, node.grid, placed, hash, depth) + lineScore * lines);
+        }
+        own.evaluated += own.finder.size();
+        sum += best;
+    }
+    average = sum / 7;
+    table.store(key, average, depth);
+    return average + lineScore * node.lines;
+}
+
+// Merges the arenas and turns the best candidates into the next beam,
+// sorted best first. Equal boards score the same, so a board already kept
+// is looked for among the ones with its score. Ties go to the earlier
+// board and placement, the result does not depend on which worker scored
+// what.
+bool BeamSearch::keepBest(BlockType type, bool firstPiece) {
+    merged.clear();
+    for (auto& own : arenas) {
+        merged.insert(merged.end(), own->candidates.begin(), own->candidates.end());
+        own->candidates.clear();
+    }
+    if (merged.empty()) {
+        return false;
+    }
+    std::sort(merged.begin(), merged.end(), [](const Candidate& a, const Candidate& b) {
+        if (a.score != b.score) {
+            return a.score > b.score;
+        }
+        if (a.parent != b.parent) {
+            return a.parent < b.parent;
+        }
+        if (a.placement.y != b.placement.y) {
+            return a.placement.y < b.placement.y;
+        }
+        if (a.placement.rotation != b.placement.rotation) {
+            return a.placement.rotation < b.placement.rotation;
+        }
+        return a.placement.x < b.placement.x;
+    });
+
+    nextBeam.clear();
+    for (std::size_t i = 0; i < merged.size() && nextBeam.size() < settings.beamWidth; ++i) {
+        const Candidate& candidate = merged[i];
+        bool seen = false;
+        for (std::size_t k = i; k > 0 && merged[k - 1].score == candidate.score && !seen; --k) {
+            seen = merged[k - 1].hash == candidate.hash;
+        }
+        if (seen) {
+            continue;
+        }
+        const Node& parent = beam[static_cast<std::size_t>(candidate.parent)];
+        Node& child = nextBeam.emplace_back();
+        child.grid = parent.grid;
+        child.grid.placeBlock(Block(type, 0, candidate.placement.x, candidate.placement.y, candidate.placement.rotation));
+        child.grid.clearLines();
+        child.lines = parent.lines + candidate.lines;
+        child.root = firstPiece ? candidate.placement : parent.root;
+        child.score = candidate.score;
+    }
+    beam.swap(nextBeam);
+    return true;
+}
+
+SearchResult BeamSearch::search(const Grid& grid, const Block& piece, const std::vector<BlockType>& preview,
+                                const EvalWeights& weights) {
+    SearchResult result;
+    deadline = std::chrono::steady_clock::now() + settings.budget;
+    outOfTime.store(false, std::memory_order_relaxed);
+    for (auto& own : arenas) {
+        own->evaluated = 0;
+        own->cacheHits = 0;
+    }
+
+    // Scores in the table are only good for the weights they were made with
+    EvalWeights board = weights;
+    board.linesCleared = 0;
+    if (!(board == boardWeights)) {
+        boardWeights = board;
+        table.clear();
+    }
+    lineScore = weights.linesCleared;
+    table.newSearch();
+
+    // The current piece always gets a full level, whatever the budget
+    beam.assign(1, Node{grid, 0, {}, 0});
+    expand(*arenas.back(), 0, piece, 0);
+    if (!keepBest(piece.getType(), true)) {
+        return result;
+    }
+    result.depthReached = 1;
+
+    int depth = std::min(settings.depth, static_cast<int>(preview.size()) + 2);
+    for (int level = 1; level < depth && !outOfTime.load(std::memory_order_relaxed); ++level) {
+        bool known = level - 1 < static_cast<int>(preview.size());
+        if (known) {
+            Block next(preview[static_cast<std::size_t>(level - 1)], 0, Block::SPAWN_X, Block::SPAWN_Y, 0);
+            for (std::size_t i = 0; i < beam.size(); ++i) {
+                pool.submit([this, i, next, level]() {
+                    if (!pastDeadline()) {
+                        expand(arena(), static_cast<int>(i), next, level);
+                    }
+                });
+            }
+            pool.wait();
+            if (outOfTime.load(std::memory_order_relaxed)) {
+                for (auto& own : arenas) {
+                    own->candidates.clear();
+                }
+                break;
+            }
+            if (!keepBest(next.getType(), false)) {
+                break;  // Every board in the beam tops out, keep the last level
+            }
+        } else {
+            averages.assign(beam.size(), GAME_OVER_SCORE);
+            for (std::size_t i = 0; i < beam.size(); ++i) {
+                pool.submit([this, i, level]() {
+                    if (!pastDeadline()) {
+                        averages[i] = averageOverPieces(arena(), beam[i], level);
+                    }
+                });
+            }
+            pool.wait();
+            if (outOfTime.load(std::memory_order_relaxed)) {
+                break;
+            }
+            auto best = std::max_element(averages.begin(), averages.end());   // First of equal ones
+            std::size_t index = static_cast<std::size_t>(best - averages.begin());
+            std::swap(beam.front(), beam[index]);
+            beam.front().score = *best;
+        }
+        result.depthReached = level + 1;
+    }
+
+    result.found = true;
+    result.placement = beam.front().root;
+    result.score = beam.front().score;
+    for (const auto& own : arenas) {
+        result.evaluated += own->evaluated;
+        result.cacheHits += own->cacheHits;
+    }
+    return result;
+}
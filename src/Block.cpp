@@ -1,6 +1,6 @@
 #include "Block.h"
-#include <cstdlib>
 #include <vector>
+#include <array>
 #include <sstream>
 #include <iostream>
 #include <fstream>
@@ -45,27 +45,64 @@ const int BASIC_COLORS[] = {
 
 const int NUM_BASIC_COLORS = sizeof(BASIC_COLORS) / sizeof(BASIC_COLORS[0]);
 
-Block::Block() {
-    type = static_cast<BlockType>(rand() % 7);            // Random block type
-    shape = SHAPES[type];                                 // Initialize shape
-    color = BASIC_COLORS[rand() % NUM_BASIC_COLORS];      // Random color
-    x = 3;                                                // Position (center of the grid)
-    y = 0;                                                // Position (top of the grid)
+// Each orientation is the previous one turned clockwise about its top left
+static std::array<std::array<BlockShape, 4>, 7> buildRotations() {
+    std::array<std::array<BlockShape, 4>, 7> rotations{};
+    for (std::size_t type = 0; type < SHAPES.size(); ++type) {
+        std::vector<std::vector<int>> shape = SHAPES[type];
+        for (auto& cells : rotations[type]) {
+            int n = shape.size();
+            int m = shape[0].size();
+            cells.height = static_cast<std::uint8_t>(n);
+            cells.width = static_cast<std::uint8_t>(m);
+            for (int i = 0; i < n; ++i) {
+                for (int j = 0; j < m; ++j) {
+                    if (shape[i][j]) {
+                        cells.rows[i] |= static_cast<std::uint8_t>(1u << j);
+                    }
+                }
+            }
+
+            std::vector<std::vector<int>> newShape(m, std::vector<int>(n, 0));
+            for (int i = 0; i < n; ++i) {
+                for (int j = 0; j < m; ++j) {
+                    newShape[j][n - 1 - i] = shape[i][j];
+                }
+            }
+            shape = newShape;
+        }
+    }
+    return rotations;
 }
 
-void Block::rotate() {
-    int n = shape.size();
-    int m = shape[0].size();
-    std::vector<std::vector<int>> newShape(m, std::vector<int>(n, 0));
-
-    // Rotate the block
-    for (int i = 0; i < n; ++i) {
-        for (int j = 0; j < m; ++j) {
-            newShape[j][n - 1 - i] = shape[i][j];
+static const std::array<std::array<BlockShape, 4>, 7> ROTATIONS = buildRotations();
+
+Block::Block(Rng& rng) {
+    type = static_cast<BlockType>(rng.nextInt(7));        // Random block type
+    color = BASIC_COLORS[rng.nextInt(NUM_BASIC_COLORS)];  // Random color
+    x = SPAWN_X;                                          // Position (center of the grid)
+    y = SPAWN_Y;                                          // Position (top of the grid)
+}
+
+// Rebuild a block saved with its rotation
+Block::Block(BlockType type, int color, int x, int y, int rotation)
+    : type(type), x(x), y(y), color(color), rotation(rotation % 4) {}
+
+int basicColorIndex(int color) {
+    for (int i = 0; i < NUM_BASIC_COLORS; ++i) {
+        if (BASIC_COLORS[i] == color) {
+            return i;
         }
     }
+    return 0;
+}
 
-    shape = newShape;
+int basicColor(int index) {
+    return BASIC_COLORS[index % NUM_BASIC_COLORS];
+}
+
+void Block::rotate() {
+    rotation = (rotation + 1) % 4;
 }
 
 void Block::move(int dx, int dy) {
@@ -73,7 +110,22 @@ void Block::move(int dx, int dy) {
     y += dy;
 }
 
+const BlockShape& Block::getCells() const {
+    return ROTATIONS[type][rotation];
+}
+
+const BlockShape& Block::shapeOf(BlockType type, int rotation) {
+    return ROTATIONS[type][rotation & 3];
+}
+
 std::vector<std::vector<int>> Block::getShape() const {
+    const BlockShape& cells = getCells();
+    std::vector<std::vector<int>> shape(cells.height, std::vector<int>(cells.width, 0));
+    for (int i = 0; i < cells.height; ++i) {
+        for (int j = 0; j < cells.width; ++j) {
+            shape[i][j] = (cells.rows[i] >> j) & 1;
+        }
+    }
     return shape;
 }
 
@@ -83,14 +135,16 @@ int Block::getColor() const { return color; }
 
 int Block::getX() const { return x; }
 int Block::getY() const { return y; }
+int Block::getRotation() const { return rotation; }
 
 // Serialize the block data for online play
 std::string Block::serialize() const {
     std::ostringstream oss;
     oss << static_cast<int>(type) << ";" << color << ";" << x << ";" << y << ";";
-    for (const auto& row : shape) {
-        for (const auto& cell : row) {
-            oss << cell << ",";
+    const BlockShape& cells = getCells();
+    for (int i = 0; i < cells.height; ++i) {
+        for (int j = 0; j < cells.width; ++j) {
+            oss << ((cells.rows[i] >> j) & 1) << ",";
         }
         oss << ";";
     }
@@ -102,7 +156,7 @@ void Block::deserialize(const std::string& data) {
     std::string value;
     
     std::getline(iss, value, ';');
-    type = static_cast<BlockType>(std::stoi(value));
+    type = static_cast<BlockType>(std::stoi(value) % 7);
     std::getline(iss, value, ';');
     color = std::stoi(value);
 
@@ -111,14 +165,27 @@ void Block::deserialize(const std::string& data) {
     std::getline(iss, value, ';');
     y = std::stoi(value);
 
-    shape.clear();
-    while (std::getline(iss, value, ';')) {
-        std::vector<int> row;
+    // The orientation is whichever one has these cells
+    BlockShape cells{};
+    while (std::getline(iss, value, ';') && cells.height < cells.rows.size()) {
         std::istringstream rowStream(value);
         std::string cell;
+        int column = 0;
         while (std::getline(rowStream, cell, ',')) {
-            row.push_back(std::stoi(cell));
+            if (std::stoi(cell)) {
+                cells.rows[cells.height] |= static_cast<std::uint8_t>(1u << column);
+            }
+            ++column;
+        }
+        cells.width = static_cast<std::uint8_t>(column);
+        ++cells.height;
+    }
+    rotation = 0;
+    for (int turns = 0; turns < 4; ++turns) {
+        const BlockShape& candidate = ROTATIONS[type % 7][turns];
+        if (candidate.width == cells.width && candidate.height == cells.height && candidate.rows == cells.rows) {
+            rotation = turns;
+            break;
         }
-        shape.push_back(row);
     }
 }
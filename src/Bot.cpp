@@ -0,0 +1,80 @@
+#include "Bot.h"
+#include "Game.h"
+
+Bot::Bot(const EvalWeights& weights, int inputsPerTick) : weights(weights), inputsPerTick(inputsPerTick) {}
+
+void Bot::setSearch(std::unique_ptr<BeamSearch> newSearch) {
+    search = std::move(newSearch);
+    planned = false;
+}
+
+void Bot::play(Game& game) {
+    if (game.isGameOver()) {
+        planned = false;
+        return;
+    }
+    const Block& piece = game.getCurrentBlock();
+    if (!onPlan(piece)) {
+        plan(game.getGrid(), piece, game.getNextBlock().getType());
+    }
+    for (int inputs = 0; inputs < inputsPerTick && pathIndex < path.size(); ++inputs) {
+        if (!game.applyInput(path[pathIndex++])) {
+            planned = false;    // Plan again next tick
+            return;
+        }
+    }
+    expected = game.getCurrentBlock();
+}
+
+bool Bot::onPlan(const Block& piece) const {
+    return planned && piece.getType() == expected.getType() && piece.getX() == expected.getX() &&
+           piece.getY() == expected.getY() && piece.getRotation() == expected.getRotation();
+}
+
+// A piece that fell or was pushed off its path keeps its target as long
+// as the board is the same and the target can still be reached, so the
+// search runs once per piece
+void Bot::plan(const Grid& grid, const Block& piece, BlockType next) {
+    planned = true;
+    pathIndex = 0;
+    expected = piece;
+
+    finder.find(grid, piece);
+    if (targeted && piece.getType() == targetType && grid.getRows() == targetRows) {
+        path = finder.pathTo(target);
+        if (!path.empty()) {
+            return;
+        }
+    }
+    path.clear();
+    targeted = false;
+
+    if (search) {
+        SearchResult result = search->search(grid, piece, {next}, weights);
+        if (result.found) {
+            aim(grid, piece, result.placement);
+        }
+        return;
+    }
+
+    const Placement* best = nullptr;
+    double bestScore = 0;
+    for (const Placement& placement : finder) {
+        double score = scorePlacement(grid, finder.blockAt(placement), weights);
+        if (!best || score > bestScore) {
+            best = &placement;
+            bestScore = score;
+        }
+    }
+    if (best) {
+        aim(grid, piece, *best);
+    }
+}
+
+void Bot::aim(const Grid& grid, const Block& piece, const Placement& placement) {
+    path = finder.pathTo(placement);
+    target = placement;
+    targetType = piece.getType();
+    targetRows = grid.getRows();
+    targeted = true;
+}
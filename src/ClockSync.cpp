@@ -0,0 +1,63 @@
+#include "ClockSync.h"
+#include <algorithm>
+
+void ClockSync::reset() {
+    next = 0;
+    count = 0;
+    anchorMs = 0.0;
+    offset = 0.0;
+    drift = 0.0;
+    bestRtt = 0.0;
+    baseSet = false;
+    baseLocalMs = 0.0;
+    baseOffsetMs = 0.0;
+}
+
+void ClockSync::addSample(double sentMs, double remoteMs, double receivedMs) {
+    double rtt = receivedMs - sentMs;
+    if (rtt < 0.0) {
+        return;
+    }
+    // Assume the remote clock was read halfway through the round trip
+    double midpoint = sentMs + rtt / 2.0;
+    window[next] = {midpoint, remoteMs - midpoint, rtt};
+    next = (next + 1) % WINDOW;
+    count = std::min(count + 1, WINDOW);
+    anchorMs = midpoint;
+    refit();
+}
+
+double ClockSync::toRemote(double localMs) const {
+    return localMs + offset + drift * (localMs - anchorMs);
+}
+
+void ClockSync::refit() {
+    std::array<Sample, WINDOW> best;
+    std::copy(window.begin(), window.begin() + count, best.begin());
+    std::size_t used = std::max<std::size_t>(1, count / 4);
+    std::partial_sort(best.begin(), best.begin() + used, best.begin() + count,
+                      [](const Sample& a, const Sample& b) { return a.rttMs < b.rttMs; });
+    bestRtt = best[0].rttMs;
+
+    double meanLocal = 0.0;
+    double meanOffset = 0.0;
+    for (std::size_t i = 0; i < used; ++i) {
+        meanLocal += best[i].localMs;
+        meanOffset += best[i].offsetMs;
+    }
+    meanLocal /= used;
+    meanOffset /= used;
+
+    // Drift is far below what queueing does to one window, it only shows
+    // against the first estimate once enough time has passed
+    if (!baseSet && synced()) {
+        baseSet = true;
+        baseLocalMs = meanLocal;
+        baseOffsetMs = meanOffset;
+    }
+    if (baseSet && meanLocal - baseLocalMs >= MIN_DRIFT_SPAN_MS) {
+        drift = std::clamp((meanOffset - baseOffsetMs) / (meanLocal - baseLocalMs),
+                           -MAX_DRIFT_PPM * 1e-6, MAX_DRIFT_PPM * 1e-6);
+    }
+    offset = meanOffset + drift * (anchorMs - meanLocal);
+}
@@ -0,0 +1,127 @@
+#include "Evaluator.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+
+// Counts the set bits of each 16 bit lane at once, the counts end up in
+// the lanes. Four masks of a row are counted with one call.
+static std::uint64_t laneCounts(std::uint64_t lanes) {
+    lanes -= (lanes >> 1) & 0x5555555555555555ull;
+    lanes = (lanes & 0x3333333333333333ull) + ((lanes >> 2) & 0x3333333333333333ull);
+    lanes = (lanes + (lanes >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+    return (lanes + (lanes >> 8)) & 0x00FF00FF00FF00FFull;
+}
+
+static int lane(std::uint64_t lanes, int index) {
+    return static_cast<int>((lanes >> (16 * index)) & 0xFFFF);
+}
+
+using Rows = std::array<std::uint16_t, Grid::MAX_HEIGHT>;
+
+static BoardFeatures measureRows(const Rows& rows, int width, int height, int linesCleared) {
+    BoardFeatures features;
+    features.linesCleared = linesCleared;
+    const std::uint64_t full = (1u << width) - 1;
+    const std::uint64_t inner = full >> 1;              // Columns that have a right neighbour
+    const std::uint64_t rightWall = 1u << (width - 1);
+    const std::uint64_t walls = 1u | rightWall;
+
+    // Rows above the stack only have the two changes at the walls
+    int top = 0;
+    while (top < height && !rows[top]) {
+        ++top;
+    }
+    features.rowTransitions = 2 * top;
+
+    std::uint64_t covered = 0;      // Columns with a filled cell at or above this row
+    std::uint64_t above = 0;        // The previous row
+    std::uint64_t depth0 = 0, depth1 = 0, depth2 = 0, depth3 = 0, depth4 = 0; // Well depth per column, bit by bit
+    std::uint64_t shape = 0;        // Lanes: height, holes, bumpiness, column transitions
+    std::uint64_t edges = 0;        // Lanes: row transitions inside, at the walls, depth bit 4
+    std::uint64_t wellDepths = 0;   // Lane k: depth bit k
+    for (int y = top; y < height; ++y) {
+        std::uint64_t row = rows[y];
+
+        // Wells: open from above, with filled cells or walls on both sides.
+        // Every well cell adds its depth so far, which sums to 1 + 2 + ...
+        std::uint64_t well = ~row & ~covered & ((row << 1) | 1) & ((row >> 1) | rightWall) & full;
+        std::uint64_t carry = well;
+        depth0 ^= carry;
+        carry &= ~depth0;
+        depth1 ^= carry;
+        carry &= ~depth1;
+        depth2 ^= carry;
+        carry &= ~depth2;
+        depth3 ^= carry;
+        carry &= ~depth3;
+        depth4 ^= carry;
+        depth0 &= well;
+        depth1 &= well;
+        depth2 &= well;
+        depth3 &= well;
+        depth4 &= well;
+        wellDepths += laneCounts(depth0 | depth1 << 16 | depth2 << 32 | depth3 << 48);
+
+        covered |= row;
+        shape += laneCounts(covered | (covered & ~row) << 16 | ((covered ^ (covered >> 1)) & inner) << 32 |
+                            (above ^ row) << 48);
+        edges += laneCounts(((row ^ (row >> 1)) & inner) | (~row & walls) << 16 | depth4 << 32);
+        above = row;
+    }
+
+    features.aggregateHeight = lane(shape, 0);
+    features.holes = lane(shape, 1);
+    features.bumpiness = lane(shape, 2);
+    features.columnTransitions = lane(shape, 3) + std::popcount(~above & full);  // Onto the floor
+    features.rowTransitions += lane(edges, 0) + lane(edges, 1);
+    features.wells = lane(wellDepths, 0) + 2 * lane(wellDepths, 1) + 4 * lane(wellDepths, 2) +
+                     8 * lane(wellDepths, 3) + 16 * lane(edges, 2);
+    return features;
+}
+
+BoardFeatures measureBoard(const Grid& grid, int linesCleared) {
+    return measureRows(grid.getRows(), grid.getWidth(), grid.getHeight(), linesCleared);
+}
+
+double scoreBoard(const BoardFeatures& features, const EvalWeights& weights) {
+    return weights.aggregateHeight * features.aggregateHeight +
+           weights.holes * features.holes +
+           weights.bumpiness * features.bumpiness +
+           weights.rowTransitions * features.rowTransitions +
+           weights.columnTransitions * features.columnTransitions +
+           weights.wells * features.wells +
+           weights.linesCleared * features.linesCleared;
+}
+
+// Only the row masks are copied, the colors do not change the score
+double scorePlacement(const Grid& grid, const Block& piece, const EvalWeights& weights, int earlierLines) {
+    Rows rows = grid.getRows();
+    int width = grid.getWidth();
+    int height = grid.getHeight();
+    const unsigned int full = (1u << width) - 1;
+    const BlockShape& cells = piece.getCells();
+    bool filledRow = false;
+    for (int i = 0; i < cells.height; ++i) {
+        int y = piece.getY() + i;
+        if (y >= 0 && y < height) {
+            rows[y] |= static_cast<std::uint16_t>((cells.rows[i] << piece.getX()) & full);
+            filledRow |= rows[y] == full;
+        }
+    }
+
+    // Full rows drop out and the ones above move down
+    int lines = earlierLines;
+    if (filledRow) {
+        int to = height;
+        for (int from = height - 1; from >= 0; --from) {
+            if (rows[from] == full) {
+                ++lines;
+            } else {
+                rows[--to] = rows[from];
+            }
+        }
+        std::fill(rows.begin(), rows.begin() + to, 0);
+    }
+    return scoreBoard(measureRows(rows, width, height, lines), weights);
+}
@@ -1,8 +1,14 @@
 #include "Game.h"
+#include "Bot.h"
 #include "Button.h"
 #include <time.h>
 #include <SDL.h>
 #include <SDL_ttf.h>
+#include <algorithm>
+#include <filesystem>
+#include <iomanip>
+#include <random>
+#include <sstream>
 #include <string>
 #include <iostream>
 #include <fstream>
@@ -10,74 +16,150 @@
 extern std::ofstream logFile;
 extern void log(const std::string& message);
 
+// Fresh seed for every game, the replay stores it
+static std::uint64_t newSeed() {
+    std::random_device device;
+    return (static_cast<std::uint64_t>(device()) << 32) ^ device() ^ static_cast<std::uint64_t>(time(nullptr));
+}
+
 Game::Game(SDL_Renderer* renderer) : renderer(renderer), paused(false), quit(false), gameOver(false) {
-    srand(static_cast<unsigned>(time(nullptr)));
-    grid = new Grid(10, 20);
-    currentBlock = new Block();
-    nextBlock = new Block();
+    seed = newSeed();
+    rng = Rng(seed);
+    grid = Grid(GRID_WIDTH, GRID_HEIGHT);
+    currentBlock = Block(rng);
+    nextBlock = Block(rng);
     score = 0;
-    speed = 1000;
+    speed = INITIAL_SPEED;
     timer = 0;
 }
 
-Game::~Game() {
-    delete currentBlock;
-    delete nextBlock;
-    delete grid;
-}
+Game::~Game() {}
 
 void Game::reset() {
+    reset(newSeed());
+}
+
+// Everything the simulation depends on starts over from the seed
+void Game::reset(std::uint64_t newSeed) {
     log("Game: reset");
     gameOver = false;
     paused = false;
     quit = false;
-    delete grid;
-    grid = new Grid(10, 20);
-    delete currentBlock;
-    currentBlock = new Block();
-    speed = 1000;
+    seed = newSeed;
+    rng = Rng(seed);
+    grid = Grid(GRID_WIDTH, GRID_HEIGHT);
+    currentBlock = Block(rng);
+    nextBlock = Block(rng);
+    score = 0;
+    speed = INITIAL_SPEED;
     timer = 0;
+    tick = 0;
+    tickAccumulator = 0;
+    playback = nullptr;
+    recording.clear();
+    recording.seed = seed;
+    recording.settings = settings();
     log("Reset complete");
 }
 
+ReplaySettings Game::settings() {
+    ReplaySettings rules;
+    rules.width = GRID_WIDTH;
+    rules.height = GRID_HEIGHT;
+    rules.tickMs = TICK_MS;
+    rules.initialSpeed = INITIAL_SPEED;
+    rules.minSpeed = MIN_SPEED;
+    rules.speedStep = SPEED_STEP;
+    return rules;
+}
+
+void Game::setBot(std::unique_ptr<Bot> newBot) {
+    bot = std::move(newBot);
+}
+
+// Moves that do not fit are reverted and left out of the recording
+bool Game::applyInput(InputAction action) {
+    if (gameOver) {
+        return false;
+    }
+    switch (action) {
+        case InputAction::Left:
+            currentBlock.move(-1, 0);
+            if (!grid.canPlace(currentBlock)) {
+                currentBlock.move(1, 0); // Revert
+                return false;
+            }
+            break;
+        case InputAction::Right:
+            currentBlock.move(1, 0);
+            if (!grid.canPlace(currentBlock)) {
+                currentBlock.move(-1, 0); // Revert
+                return false;
+            }
+            break;
+        case InputAction::Down:
+            currentBlock.move(0, 1);
+            if (!grid.canPlace(currentBlock)) {
+                currentBlock.move(0, -1); // Revert
+                return false;
+            }
+            break;
+        case InputAction::Rotate:
+            currentBlock.rotate();
+            if (!grid.canPlace(currentBlock)) {
+                // Revert rotation
+                currentBlock.rotate();
+                currentBlock.rotate();
+                currentBlock.rotate();
+                return false;
+            }
+            break;
+        case InputAction::Drop:
+            currentBlock.move(0, grid.landingRow(currentBlock) - currentBlock.getY());
+            lockBlock();
+            timer = 0; // The next block gets a full fall step
+            break;
+    }
+    if (!playback) {
+        recording.record(tick, action);
+    }
+    return true;
+}
+
 void Game::handleInput() {
     SDL_Event e;
     while (SDL_PollEvent(&e)) {
         if (e.type == SDL_QUIT) {
             quit = true;
         } else if (e.type == SDL_KEYDOWN) {
+            if (bot && (e.key.keysym.sym == SDLK_LEFT || e.key.keysym.sym == SDLK_RIGHT ||
+                        e.key.keysym.sym == SDLK_DOWN || e.key.keysym.sym == SDLK_UP ||
+                        e.key.keysym.sym == SDLK_SPACE)) {
+                continue;   // The bot has the piece
+            }
             switch (e.key.keysym.sym) {
                 case SDLK_LEFT:
-                    currentBlock->move(-1, 0);
-                    if (!grid->canPlace(*currentBlock)) {
-                        currentBlock->move(1, 0); // Revert
-                    }
+                    applyInput(InputAction::Left);
                     break;
                 case SDLK_RIGHT:
-                    currentBlock->move(1, 0);
-                    if (!grid->canPlace(*currentBlock)) {
-                        currentBlock->move(-1, 0); // Revert
-                    }
+                    applyInput(InputAction::Right);
                     break;
                 case SDLK_DOWN:
-                    currentBlock->move(0, 1);
-                    if (!grid->canPlace(*currentBlock)) {
-                        currentBlock->move(0, -1); // Revert
-                    }
+                    applyInput(InputAction::Down);
                     break;
                 case SDLK_UP:
-                    currentBlock->rotate();
-                    if (!grid->canPlace(*currentBlock)) {
-                        // Revert rotation
-                        currentBlock->rotate();
-                        currentBlock->rotate();
-                        currentBlock->rotate();
-                    }
+                    applyInput(InputAction::Rotate);
+                    break;
+                case SDLK_SPACE:
+                    applyInput(InputAction::Drop);
                     break;
                 case SDLK_ESCAPE:
                     paused = true;
                     showPauseMenu();
                     break;
+                default:
+                    handleExtraKey(e.key.keysym.sym);
+                    break;
             }
         }
     }
@@ -177,30 +259,248 @@ void Game::showPauseMenu() {
     }
 }
 
+// Run as many fixed ticks as the elapsed time covers
 void Game::update(Uint32 deltaTime) {
-    static Uint32 accumulatedTime = 0;
-    accumulatedTime += deltaTime;
-
-    if (accumulatedTime >= speed) {
-        currentBlock->move(0, 1);
-        if (!grid->canPlace(*currentBlock)) {
-            currentBlock->move(0, -1);
-            grid->placeBlock(*currentBlock);
-            score += grid->clearLines() * 100;
-            delete currentBlock;
-            currentBlock = nextBlock;
-            nextBlock = new Block();
-
-            if (!grid->canPlace(*currentBlock)) {
-                gameOver = true;
-            }
+    tickAccumulator += std::min(deltaTime, MAX_FRAME_MS);
+    while (tickAccumulator >= TICK_MS && !gameOver) {
+        tickAccumulator -= TICK_MS;
+        step();
+    }
+}
+
+// The current block stays where it is, the next one comes in
+void Game::lockBlock() {
+    grid.placeBlock(currentBlock);
+    score += grid.clearLines() * 100;
+    currentBlock = nextBlock;
+    nextBlock = Block(rng);
+
+    if (!grid.canPlace(currentBlock)) {
+        gameOver = true;
+    }
+}
+
+// Kept until the block moves or the grid changes, frames in between reuse
+// it. Only for drawing, the simulation never depends on the cache.
+int Game::ghostLandingRow() {
+    const Block& block = currentBlock;
+    if (ghostGrid != grid.getHash() || ghostBlock.getType() != block.getType() ||
+        ghostBlock.getRotation() != block.getRotation() || ghostBlock.getX() != block.getX() ||
+        ghostBlock.getY() != block.getY()) {
+        ghostBlock = block;
+        ghostGrid = grid.getHash();
+        ghostRow = grid.landingRow(block);
+    }
+    return ghostRow;
+}
+
+// One simulation tick. Only the seed and the inputs decide what happens here,
+// never the wall clock, which is what makes replays possible.
+void Game::step() {
+    if (gameOver) {
+        return;
+    }
+    if (playback) {
+        const auto& events = playback->events;
+        while (playbackIndex < events.size() && events[playbackIndex].tick <= tick) {
+            applyInput(events[playbackIndex++].action);
         }
-        accumulatedTime = 0;
+    } else if (bot) {
+        bot->play(*this);
+    }
+
+    ++tick;
+    timer += TICK_MS;
+    if (timer < static_cast<int>(speed)) {
+        return;
+    }
+
+    currentBlock.move(0, 1);
+    if (!grid.canPlace(currentBlock)) {
+        currentBlock.move(0, -1);
+        lockBlock();
+    }
+    timer = 0;
+
+    // Speed up logic
+    if (speed > MIN_SPEED) {
+        speed -= SPEED_STEP;
+    }
+}
+
+void Game::startPlayback(const Replay& replay) {
+    reset(replay.seed);
+    playback = &replay;
+    playbackIndex = 0;
+}
 
-        // Speed up logic
-        if (speed > 200) {
-            speed -= 10;
+bool Game::finishPlayback(const Replay& replay) {
+    playback = nullptr;
+    bool matches = tick == replay.finalTick && static_cast<std::uint32_t>(score) == replay.finalScore;
+    if (!matches) {
+        log("Replay diverged: tick " + std::to_string(tick) + " score " + std::to_string(score) +
+            ", recorded tick " + std::to_string(replay.finalTick) + " score " + std::to_string(replay.finalScore));
+    }
+    return matches;
+}
+
+void Game::seekReplay(const Replay& replay, const ReplayKeyframe* keyframe, std::uint32_t targetTick) {
+    startPlayback(replay);
+    if (keyframe && keyframe->tick <= targetTick) {
+        restoreKeyframe(*keyframe);
+    }
+    while (!gameOver && tick < targetTick) {
+        step();
+    }
+}
+
+static ReplayKeyframe::Piece savePiece(const Block& block) {
+    return {static_cast<std::uint8_t>(block.getType()), static_cast<std::uint8_t>(block.getRotation()),
+            static_cast<std::uint8_t>(basicColorIndex(block.getColor())),
+            static_cast<std::int8_t>(block.getX()), static_cast<std::int8_t>(block.getY())};
+}
+
+static Block loadPiece(const ReplayKeyframe::Piece& piece) {
+    return Block(static_cast<BlockType>(piece.type % 7), basicColor(piece.color), piece.x, piece.y, piece.rotation);
+}
+
+GameState Game::save() const {
+    return {grid, currentBlock, nextBlock, rng, tick,
+            static_cast<std::uint32_t>(playback ? playbackIndex : recording.events.size()),
+            score, speed, timer, gameOver};
+}
+
+void Game::restore(const GameState& state) {
+    grid = state.grid;
+    currentBlock = state.current;
+    nextBlock = state.next;
+    rng = state.rng;
+    tick = state.tick;
+    tickAccumulator = 0;
+    if (playback) {
+        playbackIndex = state.eventIndex;
+    } else if (state.eventIndex < recording.events.size()) {
+        recording.events.resize(state.eventIndex);
+    }
+    score = state.score;
+    speed = state.speed;
+    timer = state.timer;
+    gameOver = state.gameOver;
+}
+
+ReplayKeyframe Game::captureKeyframe() const {
+    GameState state = save();
+    ReplayKeyframe keyframe{};
+    keyframe.tick = state.tick;
+    keyframe.eventIndex = state.eventIndex;
+    keyframe.rngState = state.rng.state;
+    keyframe.score = static_cast<std::uint32_t>(state.score);
+    keyframe.speed = state.speed;
+    keyframe.timer = state.timer;
+    keyframe.current = savePiece(state.current);
+    keyframe.next = savePiece(state.next);
+    keyframe.gameOver = state.gameOver;
+    for (int y = 0; y < GRID_HEIGHT; ++y) {
+        for (int x = 0; x < GRID_WIDTH; ++x) {
+            int color = state.grid.getCellColor(x, y);
+            keyframe.cells[y * GRID_WIDTH + x] = color ? static_cast<std::uint8_t>(basicColorIndex(color) + 1) : 0;
+        }
+    }
+    return keyframe;
+}
+
+// Keeps the replay being played back, its inputs continue after eventIndex
+void Game::restoreKeyframe(const ReplayKeyframe& keyframe) {
+    GameState state;
+    state.grid = Grid(GRID_WIDTH, GRID_HEIGHT);
+    for (int y = 0; y < GRID_HEIGHT; ++y) {
+        for (int x = 0; x < GRID_WIDTH; ++x) {
+            std::uint8_t cell = keyframe.cells[y * GRID_WIDTH + x];
+            state.grid.setCell(x, y, cell ? basicColor(cell - 1) : 0);
+        }
+    }
+    state.current = loadPiece(keyframe.current);
+    state.next = loadPiece(keyframe.next);
+    state.rng.state = keyframe.rngState;
+    state.tick = keyframe.tick;
+    state.eventIndex = keyframe.eventIndex;
+    state.score = static_cast<int>(keyframe.score);
+    state.speed = keyframe.speed;
+    state.timer = keyframe.timer;
+    state.gameOver = keyframe.gameOver != 0;
+    restore(state);
+}
+
+bool Game::runReplay(const Replay& replay) {
+    if (!(replay.settings == settings())) {
+        log("Replay was recorded with different rules");
+        return false;
+    }
+    startPlayback(replay);
+    while (!gameOver && tick < replay.finalTick) {
+        step();
+    }
+    return finishPlayback(replay);
+}
+
+// Realtime plays at the recorded speed from startTick, otherwise the result
+// is computed at once and only the final board is shown
+void Game::showReplay(const Replay& replay, bool realtime, const ReplayKeyframe* keyframe, std::uint32_t startTick) {
+    if (!(replay.settings == settings())) {
+        log("Replay was recorded with different rules");
+        return;
+    }
+    if (!realtime) {
+        runReplay(replay);
+    } else {
+        seekReplay(replay, keyframe, startTick);
+        Uint32 lastTime = SDL_GetTicks();
+        while (!quit && !gameOver && tick < replay.finalTick) {
+            SDL_Event e;
+            while (SDL_PollEvent(&e)) {
+                if (e.type == SDL_QUIT || (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_ESCAPE)) {
+                    quit = true;
+                }
+            }
+            Uint32 currentTime = SDL_GetTicks();
+            tickAccumulator += std::min(currentTime - lastTime, MAX_FRAME_MS);
+            lastTime = currentTime;
+            while (tickAccumulator >= TICK_MS && !gameOver && tick < replay.finalTick) {
+                tickAccumulator -= TICK_MS;
+                step();
+            }
+            render();
+            SDL_Delay(16);
+        }
+        if (quit) {
+            playback = nullptr;
+            return;
         }
+        finishPlayback(replay);
+    }
+    renderGameOver();
+}
+
+// Written when a game ends, named like the log files
+void Game::saveRecording() {
+    if (playback || tick == 0) {
+        return;
+    }
+    recording.finalTick = tick;
+    recording.finalScore = static_cast<std::uint32_t>(score);
+
+    auto t = std::time(nullptr);
+    auto tm = *std::localtime(&t);
+    std::ostringstream oss;
+    oss << "replays/" << std::put_time(&tm, "%Y-%m-%d_%H-%M-%S") << ".trpl";
+    std::string path = oss.str();
+
+    std::error_code error;
+    std::filesystem::create_directories("replays", error);
+    if (recording.save(path)) {
+        log("Replay saved to " + path);
+    } else {
+        log("Failed to save replay: " + path);
     }
 }
 
@@ -214,24 +514,41 @@ void Game::render() {
     SDL_RenderClear(renderer);
 
     // Render grid
-    grid->render(renderer, windowWidth, windowHeight);
+    grid.render(renderer, windowWidth, windowHeight);
 
     // Render status box
     renderStatusBox(windowWidth, windowHeight);
 
-    // Render current block
-    auto shape = currentBlock->getShape();
-    int x = currentBlock->getX();
-    int y = currentBlock->getY();
-    int color = currentBlock->getColor();
+    // Render current block, with its outline where it would land
+    auto shape = currentBlock.getShape();
+    int x = currentBlock.getX();
+    int y = currentBlock.getY();
+    int color = currentBlock.getColor();
+
+    if (!gameOver) {
+        int ghostY = ghostLandingRow();
+        SDL_SetRenderDrawColor(renderer, (color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF, 255);
+        for (size_t i = 0; i < shape.size(); ++i) {
+            for (size_t j = 0; j < shape[i].size(); ++j) {
+                if (shape[i][j]) {
+                    SDL_Rect rect = {
+                        grid.getGridXOffset() + static_cast<int>(x + j) * grid.getCellSize(),
+                        grid.getGridYOffset() + static_cast<int>(ghostY + i) * grid.getCellSize(),
+                        grid.getCellSize(), grid.getCellSize()
+                    };
+                    SDL_RenderDrawRect(renderer, &rect);
+                }
+            }
+        }
+    }
 
     for (size_t i = 0; i < shape.size(); ++i) {
         for (size_t j = 0; j < shape[i].size(); ++j) {
             if (shape[i][j]) {
                 SDL_Rect rect = {
-                    grid->getGridXOffset() + static_cast<int>(x + j) * grid->getCellSize(),
-                    grid->getGridYOffset() + static_cast<int>(y + i) * grid->getCellSize(),
-                    grid->getCellSize(), grid->getCellSize()
+                    grid.getGridXOffset() + static_cast<int>(x + j) * grid.getCellSize(),
+                    grid.getGridYOffset() + static_cast<int>(y + i) * grid.getCellSize(),
+                    grid.getCellSize(), grid.getCellSize()
                 };
                 SDL_SetRenderDrawColor(renderer, (color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF, 255);
                 SDL_RenderFillRect(renderer, &rect);
@@ -239,6 +556,8 @@ void Game::render() {
         }
     }
 
+    renderOverlay();
+
     // Present rendered frame
     SDL_RenderPresent(renderer);
 }
@@ -260,9 +579,9 @@ void Game::renderStatusBox(int windowWidth, int windowHeight) {
 
     // Draw current block
     int blockBoxSize;
-    if (currentBlock->getType() == I) {
+    if (currentBlock.getType() == I) {
         blockBoxSize = 120;
-    } else if (currentBlock->getType() == O) {
+    } else if (currentBlock.getType() == O) {
         blockBoxSize = 60;
     } else {
         blockBoxSize = 90;
@@ -273,9 +592,9 @@ void Game::renderStatusBox(int windowWidth, int windowHeight) {
     renderText("Next:", statusBoxX + 20, 170, 100, 30, textColor);
 
     // Draw next block
-    if (nextBlock->getType() == I) {
+    if (nextBlock.getType() == I) {
         blockBoxSize = 120;
-    } else if (nextBlock->getType() == O) {
+    } else if (nextBlock.getType() == O) {
         blockBoxSize = 60;
     } else {
         blockBoxSize = 90;
@@ -288,11 +607,9 @@ void Game::renderStatusBox(int windowWidth, int windowHeight) {
     renderText("Speed: " + std::to_string(speed), statusBoxX + 20, 420, 150, 50, textColor);
 }
 
-void Game::renderBlock(Block* block, SDL_Rect displayArea) {
-    if (!block) return;
-
-    auto shape = block->getShape();
-    int color = block->getColor();
+void Game::renderBlock(const Block& block, SDL_Rect displayArea) {
+    auto shape = block.getShape();
+    int color = block.getColor();
 
     // Calculate scaling factor
     int rows = shape.size();
@@ -361,6 +678,7 @@ void Game::show() {
             lastTime = currentTime;
             handleInput();
             if (gameOver) {
+                saveRecording();
                 renderGameOver();
                 gameStarted = false;
                 return;
@@ -372,4 +690,6 @@ void Game::show() {
         }
         SDL_Delay(16);
     }
+    saveRecording();
+    gameStarted = false;
 }
\ No newline at end of file
@@ -1,85 +1,284 @@
 #include "Grid.h"
+#include "Rng.h"
 #include <SDL.h>
+#include <algorithm>
+#include <bit>
 #include <sstream>
 
-Grid::Grid(int width, int height) : width(width), height(height) {
-    grid.resize(height, std::vector<int>(width, 0)); // Initialize grid by 0
-    gridColors.resize(height, std::vector<int>(width, 0)); // Initial color by 0
+// A cell's key is the key of its column rotated by its row. The rows above
+// a cleared line all move down one, so their part of the hash just rotates
+// by one as well. Two tables of 256 cover the low and high byte of a row.
+struct ZobristKeys {
+    std::array<std::uint64_t, 256> low;
+    std::array<std::uint64_t, 256> high;
+};
+
+static ZobristKeys buildZobristKeys() {
+    Rng rng(0x5A0B2157ull);
+    std::array<std::uint64_t, Grid::MAX_WIDTH> columns;
+    for (auto& key : columns) {
+        key = rng.next();
+    }
+    ZobristKeys keys{};
+    for (unsigned int mask = 0; mask < 256; ++mask) {
+        for (int x = 0; x < 8; ++x) {
+            if ((mask >> x) & 1) {
+                keys.low[mask] ^= columns[x];
+                keys.high[mask] ^= columns[x + 8];
+            }
+        }
+    }
+    return keys;
 }
 
+static const ZobristKeys ZOBRIST = buildZobristKeys();
+
+// Hash of the cells of a row mask at row y
+static std::uint64_t rowHash(unsigned int mask, int y) {
+    return std::rotl(ZOBRIST.low[mask & 0xFF] ^ ZOBRIST.high[(mask >> 8) & 0xFF], y);
+}
+
+Grid::Grid(int width, int height)
+    : width(std::min(width, MAX_WIDTH)), height(std::min(height, MAX_HEIGHT)) {}
+
 bool Grid::canPlace(const Block& block) const {
-    auto shape = block.getShape();
+    const BlockShape& cells = block.getCells();
     int x = block.getX();
     int y = block.getY();
 
-    for (size_t i = 0; i < shape.size(); ++i) {
-        for (size_t j = 0; j < shape[i].size(); ++j) {
-            if (shape[i][j]) { // Only check the filled cells
-                int newX = x + j;
-                int newY = y + i;
+    // Out of bounds, every column of a shape has a filled cell
+    if (x < 0 || x + cells.width > width) {
+        return false;
+    }
 
-                // Out of bounds
-                if (newX < 0 || newX >= width || newY >= height) {
-                    return false;
-                }
+    for (int i = 0; i < cells.height; ++i) {
+        int newY = y + i;
+        if (newY >= height) {
+            return false;
+        }
 
-                // Conflict with existing block
-                if (newY >= 0 && grid[newY][newX]) { // Neglect the top row
-                    return false;
-                }
-            }
+        // Conflict with existing block
+        if (newY >= 0 && (rows[newY] & (cells.rows[i] << x))) { // Neglect the top row
+            return false;
         }
     }
     return true;
 }
 
+// Above the column tops under it the block falls straight onto the highest
+// of them, the column heights give the row at once. A block below one of
+// them, tucked under an overhang, tests the row masks one row at a time.
+int Grid::landingRow(const Block& block) const {
+    const BlockShape& cells = block.getCells();
+    int x = block.getX();
+    int y = block.getY();
+
+    if (x < 0 || x + cells.width > width) {
+        return y;
+    }
+    bool aboveStack = true;
+    int landing = height;
+    for (int j = 0; j < cells.width && aboveStack; ++j) {
+        int bottom = cells.height - 1;  // Lowest cell of the block in this column
+        while (!((cells.rows[bottom] >> j) & 1)) {
+            --bottom;
+        }
+        int top = height - columnHeights[x + j];
+        aboveStack = y + bottom < top;
+        landing = std::min(landing, top - 1 - bottom);
+    }
+    if (aboveStack) {
+        return landing;
+    }
+
+    for (;; ++y) {
+        for (int i = 0; i < cells.height; ++i) {
+            int below = y + 1 + i;
+            if (below >= height || (below >= 0 && (rows[below] & (cells.rows[i] << x)))) {
+                return y;
+            }
+        }
+    }
+}
+
 void Grid::placeBlock(const Block& block) {
-    auto shape = block.getShape();
+    const BlockShape& cells = block.getCells();
     int x = block.getX();
     int y = block.getY();
-    int color = block.getColor();
+    auto color = static_cast<std::uint8_t>(basicColorIndex(block.getColor()) + 1);
 
-    for (size_t i = 0; i < shape.size(); ++i) {
-        for (size_t j = 0; j < shape[i].size(); ++j) {
-            if (shape[i][j]) {
+    for (int i = 0; i < cells.height; ++i) {
+        int newY = y + i;
+        if (newY < 0 || newY >= height) {
+            continue;
+        }
+        std::uint16_t before = rows[newY];
+        for (int j = 0; j < cells.width; ++j) {
+            if ((cells.rows[i] >> j) & 1) {
                 int newX = x + j;
-                int newY = y + i;
 
-                if (newY >= 0 && newY < height && newX >= 0 && newX < width) {
-                    grid[newY][newX] = 1; // Fix the block in the grid
-                    gridColors[newY][newX] = color; // Store the color
+                if (newX >= 0 && newX < width) {
+                    rows[newY] |= static_cast<std::uint16_t>(1u << newX); // Fix the block in the grid
+                    colors[newY][newX] = color; // Store the color
+                    if (!((before >> newX) & 1)) {
+                        addToColumn(newX, newY);
+                    }
                 }
             }
         }
+        hash ^= rowHash(rows[newY] ^ before, newY);
+        markChanged(newY);
     }
 }
 
-int Grid::clearLines() {
-    int clearedLines = 0;
+// A newly filled cell above the column's top leaves the cells in between
+// covered, one below it fills a hole
+void Grid::addToColumn(int x, int y) {
+    int top = height - columnHeights[x];
+    if (y < top) {
+        columnHoles[x] = static_cast<std::uint8_t>(columnHoles[x] + top - y - 1);
+        holes += top - y - 1;
+        aggregateHeight += top - y;
+        columnHeights[x] = static_cast<std::uint8_t>(height - y);
+    } else {
+        --columnHoles[x];
+        --holes;
+    }
+}
 
-    for (int i = 0; i < height; ++i) {
-        bool isFullLine = true;
-        for (int j = 0; j < width; ++j) {
-            if (grid[i][j] == 0) {
-                isFullLine = false;
-                break;
-            }
+// Counts the column again, for cells set one by one
+void Grid::recountColumn(int x) {
+    int top = 0;
+    while (top < height && !((rows[top] >> x) & 1)) {
+        ++top;
+    }
+    int empty = 0;
+    for (int y = top + 1; y < height; ++y) {
+        empty += !((rows[y] >> x) & 1);
+    }
+    holes += empty - columnHoles[x];
+    aggregateHeight += height - top - columnHeights[x];
+    columnHoles[x] = static_cast<std::uint8_t>(empty);
+    columnHeights[x] = static_cast<std::uint8_t>(height - top);
+}
+
+void Grid::markChanged(int y) {
+    changedTop = std::min(changedTop, y);
+    changedBottom = std::max(changedBottom, y);
+}
+
+std::uint64_t Grid::hashAfter(const Block& block, int& linesCleared) const {
+    const BlockShape& cells = block.getCells();
+    int x = block.getX();
+    int y = block.getY();
+    const unsigned int fullLine = (1u << width) - 1;
+
+    std::uint64_t after = hash;
+    bool fillsLine = false;
+    for (int i = 0; i < cells.height; ++i) {
+        int newY = y + i;
+        if (newY < 0 || newY >= height) {
+            continue;
         }
+        unsigned int shifted = x >= 0 ? cells.rows[i] << x : cells.rows[i] >> -x;
+        unsigned int added = shifted & fullLine & ~rows[newY];
+        after ^= rowHash(added, newY);
+        fillsLine |= (rows[newY] | added) == fullLine;
+    }
+    linesCleared = 0;
+    if (!fillsLine) {
+        return after;
+    }
 
-        if (isFullLine) {
+    Grid placed = *this;
+    placed.placeBlock(block);
+    linesCleared = placed.clearLines();
+    return placed.hash;
+}
+
+void Grid::setCell(int x, int y, int color) {
+    std::uint16_t before = rows[y];
+    if (color) {
+        rows[y] |= static_cast<std::uint16_t>(1u << x);
+        colors[y][x] = static_cast<std::uint8_t>(basicColorIndex(color) + 1);
+    } else {
+        rows[y] &= static_cast<std::uint16_t>(~(1u << x));
+        colors[y][x] = 0;
+    }
+    hash ^= rowHash(rows[y] ^ before, y);
+    if (rows[y] != before) {
+        recountColumn(x);
+        markChanged(y);
+    }
+}
+
+// Only rows changed since the last call can be full
+int Grid::clearLines() {
+    int clearedLines = 0;
+    const std::uint16_t fullLine = static_cast<std::uint16_t>((1u << width) - 1);
+
+    int last = std::min(changedBottom, height - 1);
+    for (int i = std::max(changedTop, 0); i <= last; ++i) {
+        if (rows[i] == fullLine) {
+            removeFromColumns(i);
+            std::uint64_t above = 0;    // Hash of the rows that move down
             for (int k = i; k > 0; --k) {
-                grid[k] = grid[k - 1];
-                gridColors[k] = gridColors[k - 1];
+                above ^= rowHash(rows[k - 1], k - 1);
+                rows[k] = rows[k - 1];
+                colors[k] = colors[k - 1];
             }
-            grid[0] = std::vector<int>(width, 0); // Clear the top line
-            gridColors[0] = std::vector<int>(width, 0); // Clear the top line color
+            hash ^= rowHash(fullLine, i) ^ above ^ std::rotl(above, 1);
+            rows[0] = 0; // Clear the top line
+            colors[0] = {}; // Clear the top line color
             ++clearedLines;
         }
     }
+    changedTop = MAX_HEIGHT;
+    changedBottom = -1;
 
     return clearedLines;
 }
 
+// Row y is full and about to go. Where it is not the top of a column,
+// the column just gets one shorter. Where it is, the empty cells under it
+// are no longer covered and the column ends at the next filled cell.
+void Grid::removeFromColumns(int y) {
+    for (int x = 0; x < width; ++x) {
+        int top = height - columnHeights[x];
+        int below = y + 1;
+        if (top == y) {
+            while (below < height && !((rows[below] >> x) & 1)) {
+                ++below;
+            }
+            columnHoles[x] = static_cast<std::uint8_t>(columnHoles[x] - (below - y - 1));
+            holes -= below - y - 1;
+        }
+        int newHeight = top == y ? height - below : columnHeights[x] - 1;
+        aggregateHeight += newHeight - columnHeights[x];
+        columnHeights[x] = static_cast<std::uint8_t>(newHeight);
+    }
+}
+
+std::vector<std::vector<int>> Grid::getGrid() const {
+    std::vector<std::vector<int>> cells(height, std::vector<int>(width, 0));
+    for (int i = 0; i < height; ++i) {
+        for (int j = 0; j < width; ++j) {
+            cells[i][j] = (rows[i] >> j) & 1;
+        }
+    }
+    return cells;
+}
+
+std::vector<std::vector<int>> Grid::getGridColors() const {
+    std::vector<std::vector<int>> cells(height, std::vector<int>(width, 0));
+    for (int i = 0; i < height; ++i) {
+        for (int j = 0; j < width; ++j) {
+            cells[i][j] = getCellColor(j, i);
+        }
+    }
+    return cells;
+}
+
 void Grid::render(SDL_Renderer* renderer, int windowWidth, int windowHeight) {
     // Calculate the size of the grid
     gridPixelHeight = windowHeight * 0.9;
@@ -103,9 +302,9 @@ void Grid::render(SDL_Renderer* renderer, int windowWidth, int windowHeight) {
     // Render the blocks
     for (int i = 0; i < height; ++i) {
         for (int j = 0; j < width; ++j) {
-            if (grid[i][j]) {
+            if ((rows[i] >> j) & 1) {
                 SDL_Rect rect = {gridXOffset + j * cellSize, gridYOffset + i * cellSize, cellSize, cellSize};
-                int color = gridColors[i][j];
+                int color = getCellColor(j, i);
                 SDL_SetRenderDrawColor(renderer, (color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF, 255);
                 SDL_RenderFillRect(renderer, &rect);
             }
@@ -116,9 +315,9 @@ void Grid::render(SDL_Renderer* renderer, int windowWidth, int windowHeight) {
 // Serialize the grid state for online play
 std::string Grid::serialize() const {
     std::ostringstream oss;
-    for (const auto& row : grid) {
-        for (const auto& cell : row) {
-            oss << cell << ",";
+    for (int i = 0; i < height; ++i) {
+        for (int j = 0; j < width; ++j) {
+            oss << ((rows[i] >> j) & 1) << ",";
         }
         oss << ";";
     }
@@ -136,7 +335,11 @@ void Grid::deserialize(const std::string& data) {
         int colIdx = 0;
 
         while (std::getline(rowStream, cellStr, ',') && colIdx < width) {
-            grid[rowIdx][colIdx] = std::stoi(cellStr);
+            if (!std::stoi(cellStr)) {
+                setCell(colIdx, rowIdx, 0);
+            } else if (!colors[rowIdx][colIdx]) {
+                setCell(colIdx, rowIdx, basicColor(0)); // Only the shape is sent, not the colors
+            }
             ++colIdx;
         }
         ++rowIdx;
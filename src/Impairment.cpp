@@ -0,0 +1,100 @@
+#include "Impairment.h"
+#include "Protocol.h"
+#include <algorithm>
+#include <charconv>
+
+// Parse a non negative number that must end exactly at the end of the text
+template <typename T>
+static bool parseValue(std::string_view text, T& value) {
+    const char* end = text.data() + text.size();
+    auto result = std::from_chars(text.data(), end, value);
+    return result.ec == std::errc() && result.ptr == end && value >= 0;
+}
+
+bool parseImpairment(std::string_view spec, ImpairmentSettings& settings) {
+    bool valid = true;
+    forEachListItem(spec, [&settings, &valid](std::string_view item) {
+        std::size_t equals = item.find('=');
+        if (equals == std::string_view::npos) {
+            valid = false;
+            return;
+        }
+        std::string_view key = item.substr(0, equals);
+        std::string_view text = item.substr(equals + 1);
+        double value = 0.0;
+        if (key == "seed") {
+            valid = valid && parseValue(text, settings.seed);
+        } else if (!parseValue(text, value)) {
+            valid = false;
+        } else if (key == "delay") {
+            settings.delayMs = value;
+        } else if (key == "jitter") {
+            settings.jitterMs = value;
+        } else if (key == "loss") {
+            settings.lossRate = std::min(value, 100.0) / 100.0;
+        } else if (key == "dup") {
+            settings.duplicateRate = std::min(value, 100.0) / 100.0;
+        } else if (key == "reorder") {
+            settings.reorderRate = std::min(value, 100.0) / 100.0;
+        } else {
+            valid = false;
+        }
+    });
+    return valid;
+}
+
+ImpairedLink::ImpairedLink(boost::asio::ip::udp::socket& socket, boost::asio::any_io_executor executor)
+    : socket(socket), executor(std::move(executor)), rng(current.seed) {}
+
+void ImpairedLink::configure(const ImpairmentSettings& settings) {
+    current = settings;
+    rng = Rng(settings.seed);
+}
+
+void ImpairedLink::send(std::shared_ptr<std::string> datagram, const boost::asio::ip::udp::endpoint& target, SendHandler handler) {
+    if (!current.active()) {
+        socket.async_send_to(boost::asio::buffer(*datagram), target,
+            boost::asio::bind_executor(executor, [datagram, handler = std::move(handler)](const boost::system::error_code& error, std::size_t bytesSent) {
+                handler(error, bytesSent);
+            }));
+        return;
+    }
+
+    // The fate of every datagram comes from the seeded generator, the same traffic gives the same run
+    double lossDraw = uniform();
+    double duplicateDraw = uniform();
+    double reorderDraw = uniform();
+    if (lossDraw < current.lossRate) {
+        ++droppedCount;
+    } else {
+        int copies = duplicateDraw < current.duplicateRate ? 2 : 1;
+        duplicatedCount += copies - 1;
+        bool heldBack = reorderDraw < current.reorderRate;
+        reorderedCount += heldBack;
+        for (int copy = 0; copy < copies; ++copy) {
+            double delay = current.delayMs + current.jitterMs * uniform() + (heldBack ? REORDER_DELAY_MS : 0.0);
+            sendAfter(datagram, target, delay);
+        }
+    }
+    boost::asio::post(executor, [handler = std::move(handler), bytes = datagram->size()]() {
+        handler(boost::system::error_code(), bytes);
+    });
+}
+
+void ImpairedLink::sendAfter(std::shared_ptr<std::string> datagram, const boost::asio::ip::udp::endpoint& target, double delayMs) {
+    auto sendNow = [this, datagram, target]() {
+        socket.async_send_to(boost::asio::buffer(*datagram), target,
+            boost::asio::bind_executor(executor, [datagram](const boost::system::error_code&, std::size_t) {}));
+    };
+    if (delayMs <= 0.0) {
+        sendNow();
+        return;
+    }
+    auto timer = std::make_shared<boost::asio::steady_timer>(executor,
+        std::chrono::microseconds(static_cast<std::int64_t>(delayMs * 1000.0)));
+    timer->async_wait([timer, sendNow](const boost::system::error_code& error) {
+        if (!error) {
+            sendNow();
+        }
+    });
+}
@@ -0,0 +1,123 @@
+#include "NetStats.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+void LatencyHistogram::add(double ms) {
+    int bucket = 0;
+    while (bucket < BUCKETS - 1 && ms >= static_cast<double>(1u << bucket)) {
+        ++bucket;
+    }
+    ++buckets[bucket];
+    minValue = samples ? std::min(minValue, ms) : ms;
+    maxValue = std::max(maxValue, ms);
+    sum += ms;
+    ++samples;
+}
+
+double LatencyHistogram::percentile(double fraction) const {
+    if (samples == 0) {
+        return 0.0;
+    }
+    std::uint32_t target = static_cast<std::uint32_t>(std::ceil(fraction * samples));
+    std::uint32_t seen = 0;
+    for (int bucket = 0; bucket < BUCKETS; ++bucket) {
+        seen += buckets[bucket];
+        if (seen >= target && buckets[bucket] > 0) {
+            // The last bucket is open ended, report the largest sample instead
+            return bucket == BUCKETS - 1 ? maxValue : std::min(maxValue, static_cast<double>(1u << bucket));
+        }
+    }
+    return maxValue;
+}
+
+void PeerStats::onReceive(std::uint16_t sequence, std::size_t bytes) {
+    ++packetsIn;
+    bytesIn += bytes;
+
+    if (!hasIncoming) {
+        hasIncoming = true;
+        highestIncoming = sequence;
+        received = 1;
+        return;
+    }
+
+    // Signed distance handles the 16 bit wrap around
+    auto delta = static_cast<std::int16_t>(static_cast<std::uint16_t>(sequence - highestIncoming));
+    if (delta > 0) {
+        packetsLost += delta - 1;
+        highestIncoming = sequence;
+        // The sequences skipped over are the new gaps
+        if (delta < HISTORY) {
+            std::uint64_t skipped = ((1ull << delta) - 1) & ~1ull;
+            received = (received << delta) | 1;
+            missing = (missing << delta) | skipped;
+        } else {
+            received = 1;
+            missing = ~1ull;
+        }
+        return;
+    }
+
+    int below = -delta;
+    if (below < HISTORY && ((received >> below) & 1)) {
+        ++packetsDuplicated;
+        return;
+    }
+    ++packetsReordered;
+    if (below < HISTORY) {
+        // Only a gap that was counted as lost is given back, a packet from
+        // before the first one or too old to remember never was
+        received |= 1ull << below;
+        if ((missing >> below) & 1) {
+            missing &= ~(1ull << below);
+            --packetsLost;
+        }
+    }
+}
+
+void PeerStats::onRttSample(double ms) {
+    if (rtt.count() == 0) {
+        smoothedRttMs = ms;
+    } else {
+        jitterMs += (std::fabs(ms - lastRttMs) - jitterMs) / 16.0;
+        smoothedRttMs += (ms - smoothedRttMs) / 8.0;
+    }
+    lastRttMs = ms;
+    rtt.add(ms);
+}
+
+double PeerStats::lossRate() const {
+    std::uint64_t expected = packetsIn - packetsDuplicated + packetsLost;
+    return expected ? static_cast<double>(packetsLost) / expected : 0.0;
+}
+
+void writeStatsHeader(std::ostream& out) {
+    out << "time_ms,peer,rtt_ms,srtt_ms,rtt_min_ms,rtt_p50_ms,rtt_p95_ms,rtt_max_ms,jitter_ms,"
+        << "packets_in,packets_out,bytes_in,bytes_out,lost,reordered,loss_pct,queue,queue_max,"
+        << "send_rate_bps,remote_loss_pct,superseded,messages_out,duplicated\n";
+}
+
+void writeStatsRow(std::ostream& out, std::uint64_t timeMs, const std::string& peer, const PeerStats& stats) {
+    out << timeMs << "," << peer << ","
+        << stats.lastRttMs << "," << stats.smoothedRttMs << ","
+        << stats.rtt.min() << "," << stats.rtt.percentile(0.5) << "," << stats.rtt.percentile(0.95) << ","
+        << stats.rtt.max() << "," << stats.jitterMs << ","
+        << stats.packetsIn << "," << stats.packetsOut << ","
+        << stats.bytesIn << "," << stats.bytesOut << ","
+        << stats.packetsLost << "," << stats.packetsReordered << ","
+        << stats.lossRate() * 100.0 << ","
+        << stats.sendQueueDepth << "," << stats.maxSendQueueDepth << ","
+        << stats.sendRateBytes << "," << stats.remoteLossRate * 100.0 << "," << stats.statesSuperseded << "," << stats.messagesOut << ","
+        << stats.packetsDuplicated << "\n";
+}
+
+std::string formatStatsLine(const std::string& peer, const PeerStats& stats) {
+    char line[192];
+    std::snprintf(line, sizeof(line), "%s rtt %.0f jit %.1f loss %.1f%% in %llu out %llu q %u rate %.1fk",
+                  peer.c_str(), stats.smoothedRttMs, stats.jitterMs, stats.lossRate() * 100.0,
+                  static_cast<unsigned long long>(stats.packetsIn),
+                  static_cast<unsigned long long>(stats.packetsOut), stats.sendQueueDepth,
+                  stats.sendRateBytes / 1000.0);
+    return line;
+}
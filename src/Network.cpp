@@ -2,15 +2,36 @@
 #include <boost/asio.hpp>
 #include <iostream>
 #include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <ctime>
 #include <thread>
 #include <vector>
 
 extern std::ofstream logFile;
 extern void log(const std::string& message);
 
-Network::Network() : ioContext(), socket(ioContext) {
+Network::Network()
+    : ioContext(), socket(ioContext), networkStrand(boost::asio::make_strand(ioContext)), link(socket, networkStrand), statsTimer(networkStrand), paceTimer(networkStrand) {
     playerList.reserve(4);
-    connectedEndpoints.reserve(10);
+    connectedPeers.reserve(MAX_PEERS);
+    members.resize(MAX_PEERS);
+    outboxes.resize(MAX_PEERS);
+    pendingOutboxes.reserve(MAX_PEERS);
+    peerStats.resize(MAX_PEERS);
+    peerSenders.resize(MAX_PEERS);
+
+    handlers[static_cast<std::uint8_t>(Opcode::RoomAnnounce)] = &Network::handleRoomAnnounce;
+    handlers[static_cast<std::uint8_t>(Opcode::JoinRoom)] = &Network::handleJoinRoomRequest;
+    handlers[static_cast<std::uint8_t>(Opcode::PlayerList)] = &Network::handlePlayerListUpdate;
+    handlers[static_cast<std::uint8_t>(Opcode::EndpointList)] = &Network::handleEndpointList;
+    handlers[static_cast<std::uint8_t>(Opcode::NewClient)] = &Network::handleNewClient;
+    handlers[static_cast<std::uint8_t>(Opcode::StartGame)] = &Network::handleStartGame;
+    handlers[static_cast<std::uint8_t>(Opcode::GameState)] = &Network::handleGameState;
+    handlers[static_cast<std::uint8_t>(Opcode::Ping)] = &Network::handlePing;
+    handlers[static_cast<std::uint8_t>(Opcode::Pong)] = &Network::handlePong;
+    handlers[static_cast<std::uint8_t>(Opcode::Fragment)] = &Network::handleFragment;
+    handlers[static_cast<std::uint8_t>(Opcode::Inputs)] = &Network::handleInputs;
     log("Network initialized");
 }
 
@@ -22,8 +43,14 @@ void Network::startListening(int port) {
         socket.set_option(boost::asio::socket_base::reuse_address(true));
         socket.bind(endpoint);
         hostEndpoint = endpoint;
+        selfEndpoint = boost::asio::ip::udp::endpoint(boost::asio::ip::make_address(getLocalIPAddress()), port);
         log("Listening started on port " + socket.local_endpoint().address().to_string() + ":" + std::to_string(port));
+        ioContext.restart();
         listenForUpdates();
+        statsTicks = 0;
+        paceTimerArmed = false;
+        flushScheduled = false;
+        scheduleStatsTick();
         std::thread([this]() {
             try {
                 ioContext.run();
@@ -37,126 +64,652 @@ void Network::startListening(int port) {
     }
 }
 
+// Arm every receive slot, the pool keeps several receives outstanding
 void Network::listenForUpdates() {
+    for (auto& slot : receiveSlots) {
+        receiveInto(slot);
+    }
+}
+
+void Network::receiveInto(ReceiveSlot& slot) {
     socket.async_receive_from(
-        boost::asio::buffer(buffer), senderEndpoint,
-        [this](const boost::system::error_code& error, std::size_t bytesTransferred) {
+        boost::asio::buffer(slot.data), slot.sender,
+        boost::asio::bind_executor(networkStrand, [this, &slot](const boost::system::error_code& error, std::size_t bytesTransferred) {
             if (!error) {
-                std::string message(buffer.data(), bytesTransferred);
-                log("Message received: " + message);
-
-                // Process the message based on the content
-                if (message.rfind("PLAYER_LIST:", 0) == 0) {
-                    handlePlayerListUpdate(message);
-                } else if (message == "JOIN_ROOM") {
-                    handleJoinRoomRequest(senderEndpoint, message);
-                } else if (message.rfind("NEW_CLIENT:", 0) == 0) {
-                    std::string endpointStr = message.substr(11);
-                    auto delimiterPos = endpointStr.find(':');
-                    std::string ip = endpointStr.substr(0, delimiterPos);
-                    int port = std::stoi(endpointStr.substr(delimiterPos + 1));
-                    boost::asio::ip::udp::endpoint newClientEndpoint(boost::asio::ip::make_address(ip), port);
-
-                    if (std::find(connectedEndpoints.begin(), connectedEndpoints.end(), newClientEndpoint) == connectedEndpoints.end()) {
-                        connectedEndpoints.push_back(newClientEndpoint);
-                        log("New client added to connectedEndpoints: " + newClientEndpoint.address().to_string() + ":" + std::to_string(newClientEndpoint.port()));
-                    }
-                } else if (gameStarted) {
-                    if (notifyGameStateCallback) {
-                        log("Notifying");
-                        notifyGameStateCallback(senderEndpoint.address().to_string(), message);
-                    }
-                } else {
-                    handleRoomStateUpdate(message);
-                }
-                log("Listening for new messages...");
-                listenForUpdates();
+                dispatchMessage(slot.sender, std::string_view(slot.data.data(), bytesTransferred));
+                receiveInto(slot);
             } else if (error == boost::asio::error::operation_aborted) {
                 log("Receive operation aborted.");
             } else {
                 log("Receive error: " + error.message());
-                listenForUpdates();
+                receiveInto(slot);
+            }
+        }));
+}
+
+void Network::dispatchMessage(const boost::asio::ip::udp::endpoint& sender, std::string_view datagram) {
+    Opcode opcode;
+    std::uint16_t sequence;
+    std::string_view payload;
+    if (!decodeMessage(datagram, opcode, sequence, payload)) {
+        return;
+    }
+    PeerId peer = peerId(sender);
+    if (peer == NO_PEER) {
+        log("Peer table full, ignoring " + formatEndpoint(sender));
+        return;
+    }
+    if (opcode == Opcode::JoinRoom) {
+        // Possibly a client restarted on the same endpoint, counting from sequence 0 again
+        restartPeerSession(peer);
+    }
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        peerStats[peer].onReceive(sequence, datagram.size());
+    }
+    members[peer].lastHeardMs = elapsedMs();
+    if (members[peer].evicted && opcode != Opcode::JoinRoom) {
+        // A restarted client joins again instead
+        readmitPeer(peer);
+    }
+    if (opcode != Opcode::Batch) {
+        dispatchFrame(peer, opcode, payload);
+    } else if (!forEachFrame(payload, [this, peer](Opcode frameOpcode, std::string_view framePayload) {
+                   dispatchFrame(peer, frameOpcode, framePayload);
+               })) {
+        log("Truncated batch from " + formatEndpoint(sender));
+    }
+}
+
+// Frames of a batch and rebuilt messages can not nest another batch
+void Network::dispatchFrame(PeerId sender, Opcode opcode, std::string_view payload) {
+    MessageHandler handler = opcode == Opcode::Batch ? nullptr : handlers[static_cast<std::uint8_t>(opcode)];
+    if (handler) {
+        (this->*handler)(sender, payload);
+    } else {
+        log("Unknown opcode " + std::to_string(static_cast<int>(opcode)) + " from " + formatEndpoint(peers.endpoint(sender)));
+    }
+}
+
+// On the strand, gives the endpoint an id the first time it shows up
+PeerId Network::peerId(const boost::asio::ip::udp::endpoint& endpoint) {
+    PeerId peer = peers.find(endpoint);
+    if (peer != NO_PEER) {
+        return peer;
+    }
+    std::unique_lock<std::mutex> lock(statsMutex);
+    peer = peers.insert(endpoint);
+    PeerId recycled = NO_PEER;
+    if (peer == NO_PEER) {
+        // Full: take over the id of the peer outside the room we heard from the longest time ago
+        std::uint32_t now = elapsedMs();
+        for (std::size_t id = 0; id < peers.limit(); ++id) {
+            const Member& member = members[id];
+            if (!member.connected && outboxes[id].count == 0 &&
+                (peer == NO_PEER || now - member.lastHeardMs > now - members[peer].lastHeardMs)) {
+                peer = static_cast<PeerId>(id);
+            }
+        }
+        if (peer == NO_PEER) {
+            return NO_PEER;
+        }
+        recycled = peer;
+        peers.erase(peer);
+        members[peer] = Member();
+        peerStats[peer] = PeerStats();
+        peerSenders[peer] = PeerSender();
+        peer = peers.insert(endpoint);
+    }
+    members[peer].lastHeardMs = elapsedMs();
+    lock.unlock();
+    // Outside the lock, the handler may ask us for names or statistics
+    if (recycled != NO_PEER) {
+        notifyPeerLeft(recycled);
+    }
+    return peer;
+}
+
+// On the strand
+void Network::addConnectedPeer(PeerId peer) {
+    if (peer != NO_PEER && !members[peer].connected) {
+        Member& member = members[peer];
+        member.connected = true;
+        member.evicted = false;
+        member.lastHeardMs = elapsedMs();
+        connectedPeers.push_back(peer);
+    }
+}
+
+void Network::clearConnectedPeers() {
+    for (PeerId peer : connectedPeers) {
+        members[peer].connected = false;
+    }
+    connectedPeers.clear();
+}
+
+// Forgets what the peer's previous session left behind: its sequence numbers,
+// round trip times and the rate its pongs earned. Our own sends keep their
+// numbering and in-flight count, those are still completing on the socket.
+void Network::restartPeerSession(PeerId peer) {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    PeerStats& stats = peerStats[peer];
+    PeerStats fresh;
+    fresh.nextOutgoingSequence = stats.nextOutgoingSequence;
+    fresh.sendQueueDepth = stats.sendQueueDepth;
+    stats = fresh;
+    PeerSender& sender = peerSenders[peer];
+    bool statePending = sender.statePending;
+    sender = PeerSender();
+    sender.statePending = statePending;
+}
+
+// A room member that has been silent for PEER_TIMEOUT_MS is dropped: pings
+// and states stop going to it, and the host takes its player out of the room
+void Network::evictSilentPeers() {
+    std::uint32_t now = elapsedMs();
+    bool rosterChanged = false;
+    for (std::size_t i = 0; i < connectedPeers.size();) {
+        PeerId peer = connectedPeers[i];
+        Member& member = members[peer];
+        if (peers.endpoint(peer) == selfEndpoint || now - member.lastHeardMs <= PEER_TIMEOUT_MS) {
+            ++i;
+            continue;
+        }
+        log("Peer timed out: " + formatEndpoint(peers.endpoint(peer)));
+        member.connected = false;
+        member.evicted = true;
+        connectedPeers.erase(connectedPeers.begin() + i);
+        {
+            std::lock_guard<std::mutex> lock(statsMutex);
+            peerSenders[peer].statePending = false;
+        }
+        if (!member.playerName.empty()) {
+            rosterChanged |= removePlayerEntry(member.playerName, member.evictedEntry);
+        }
+        notifyPeerLeft(peer);
+    }
+    if (rosterChanged) {
+        refreshRoomView();
+        broadcastPlayerList();
+    }
+}
+
+// An evicted peer that is heard from again is back in the room at once
+void Network::readmitPeer(PeerId peer) {
+    log("Peer is back: " + formatEndpoint(peers.endpoint(peer)));
+    addConnectedPeer(peer);
+    Member& member = members[peer];
+    if (!member.evictedEntry.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(playerListMutex);
+            playerList.push_back(member.evictedEntry);
+        }
+        member.evictedEntry.clear();
+        refreshRoomView();
+        broadcastPlayerList();
+    }
+    if (gameStarted) {
+        resendGameState(peer);
+    }
+}
+
+// Every state is a full snapshot, so the newest one is all a returning peer
+// needs to catch up, no matter how long it was gone
+void Network::resendGameState(PeerId peer) {
+    if (latestState.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(statsMutex);
+    peerSenders[peer].statePending = true;
+    flushGameState();
+}
+
+// Removes one entry of the player, ready or not, several guests may share a name
+bool Network::removePlayerEntry(const std::string& playerName, std::string& removed) {
+    std::lock_guard<std::mutex> lock(playerListMutex);
+    auto it = std::find_if(playerList.begin(), playerList.end(), [&playerName](const std::string& player) {
+        return player == playerName || player == playerName + " (Ready)";
+    });
+    if (it == playerList.end()) {
+        return false;
+    }
+    removed = *it;
+    playerList.erase(it);
+    return true;
+}
+
+void Network::refreshRoomView() {
+    std::vector<std::string> players = getPlayerList();
+    std::lock_guard<std::mutex> lock(roomViewMutex);
+    if (roomView) {
+        roomView->updatePlayers(players);
+    }
+}
+
+// Sends are queued on the strand so the sequence numbers and counters stay consistent
+// Messages are framed into the peer's outbox and leave at the end of the
+// current network tick, packed into as few datagrams as the MTU allows.
+// Broadcasts to the LAN go out on their own right away.
+void Network::sendMessage(Opcode opcode, std::string_view payload, const boost::asio::ip::udp::endpoint& target) {
+    bool broadcast = target.address().is_v4() && target.address().to_v4() == boost::asio::ip::address_v4::broadcast();
+    if (broadcast) {
+        auto datagram = std::make_shared<std::string>(encodeMessage(opcode, payload));
+        boost::asio::post(networkStrand, [this, datagram, target]() {
+            transmit(datagram, target, NO_PEER);
+        });
+    } else if (networkStrand.running_in_this_thread()) {
+        queueMessage(opcode, payload, peerId(target));
+    } else {
+        boost::asio::post(networkStrand, [this, opcode, payload = std::string(payload), target]() {
+            queueMessage(opcode, payload, peerId(target));
+        });
+    }
+}
+
+// On the strand, a message too large for one datagram is queued as its fragments
+void Network::queueMessage(Opcode opcode, std::string_view payload, PeerId target) {
+    if (target == NO_PEER) {
+        return;
+    }
+    Outbox& outbox = outboxes[target];
+    if (payload.size() <= MAX_UNFRAGMENTED_PAYLOAD) {
+        appendFrame(outbox.frames, opcode, payload);
+    } else if (!forEachFragment(opcode, payload, nextMessageId++, [&outbox](std::string_view fragment) {
+                   appendFrame(outbox.frames, Opcode::Fragment, fragment);
+               })) {
+        log("Message of " + std::to_string(payload.size()) + " bytes is too large to send to " + formatEndpoint(peers.endpoint(target)));
+        return;
+    }
+    if (outbox.count++ == 0) {
+        pendingOutboxes.push_back(target);
+    }
+    if (!flushScheduled) {
+        flushScheduled = true;
+        boost::asio::post(networkStrand, [this]() { flushOutboxes(); });
+    }
+}
+
+// On the strand: runs after everything that was already queued on it, so a
+// burst of handlers ends up in one datagram per peer
+void Network::flushOutboxes() {
+    flushScheduled = false;
+    for (PeerId peer : pendingOutboxes) {
+        Outbox& outbox = outboxes[peer];
+        const boost::asio::ip::udp::endpoint& target = peers.endpoint(peer);
+        if (outbox.count == 0) {
+            continue;
+        }
+
+        std::string batch;
+        std::size_t framesInBatch = 0;
+        Opcode lastOpcode = Opcode::Batch;
+        std::string_view lastPayload;
+        auto emit = [&]() {
+            if (framesInBatch == 1) {
+                // A lone message does not need the frame header
+                transmit(std::make_shared<std::string>(encodeMessage(lastOpcode, lastPayload)), target, peer);
+            } else if (framesInBatch > 1) {
+                transmit(std::make_shared<std::string>(std::move(batch)), target, peer);
+            }
+            batch = encodeMessage(Opcode::Batch);
+            framesInBatch = 0;
+        };
+        batch = encodeMessage(Opcode::Batch);
+        forEachFrame(outbox.frames, [&](Opcode opcode, std::string_view payload) {
+            if (framesInBatch > 0 && batch.size() + FRAME_HEADER_SIZE + payload.size() > MAX_DATAGRAM_SIZE) {
+                emit();
             }
+            appendFrame(batch, opcode, payload);
+            lastOpcode = opcode;
+            lastPayload = payload;
+            ++framesInBatch;
         });
+        emit();
+
+        std::lock_guard<std::mutex> lock(statsMutex);
+        peerStats[peer].messagesOut += outbox.count;
+        outbox.frames.clear();
+        outbox.count = 0;
+    }
+    pendingOutboxes.clear();
 }
 
-void Network::initializeEndPoints(){
-    connectedEndpoints.clear();
-    std::string ip = getLocalIPAddress();
-    boost::asio::ip::udp::endpoint endpoint(boost::asio::ip::make_address(ip), 12345);
-    connectedEndpoints.push_back(endpoint);
+// On the strand: stamp the per-peer sequence and hand the datagram to the link,
+// broadcasts have no peer and are not counted
+void Network::transmit(std::shared_ptr<std::string> datagram, const boost::asio::ip::udp::endpoint& target, PeerId peer) {
+    bool tracked = peer != NO_PEER;
+    if (tracked) {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        PeerStats& stats = peerStats[peer];
+        setMessageSequence(*datagram, stats.nextOutgoingSequence++);
+        stats.maxSendQueueDepth = std::max(stats.maxSendQueueDepth, ++stats.sendQueueDepth);
+    }
+    link.send(datagram, target, [this, target, peer, tracked](const boost::system::error_code& error, std::size_t bytesSent) {
+        if (error) {
+            log("Send error to " + formatEndpoint(target) + ": " + error.message());
+        }
+        if (tracked) {
+            std::lock_guard<std::mutex> lock(statsMutex);
+            PeerStats& stats = peerStats[peer];
+            --stats.sendQueueDepth;
+            if (!error) {
+                ++stats.packetsOut;
+                stats.bytesOut += bytesSent;
+            }
+        }
+    });
+}
+
+void Network::setImpairment(const ImpairmentSettings& settings) {
+    boost::asio::post(networkStrand, [this, settings]() {
+        link.configure(settings);
+    });
+    log("Link impairment: delay " + std::to_string(settings.delayMs) + " ms, jitter " + std::to_string(settings.jitterMs) +
+        " ms, loss " + std::to_string(settings.lossRate) + ", duplicates " + std::to_string(settings.duplicateRate) +
+        ", reorder " + std::to_string(settings.reorderRate));
 }
 
-void Network::handleRoomStateUpdate(const std::string& message) {
-    // Process the message and update room state
-    if (message == "START_GAME") {
-        if (gameStarted) {
-            log("Game already started. Ignoring duplicate START_GAME message.");
+std::uint32_t Network::elapsedMs() const {
+    return static_cast<std::uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - startTime).count());
+}
+
+// With statsMutex held
+std::uint32_t Network::matchTime() const {
+    std::uint32_t now = elapsedMs();
+    if (clockPeer == NO_PEER) {
+        return now;
+    }
+    return static_cast<std::uint32_t>(static_cast<std::int64_t>(clockSync.toRemote(now)));
+}
+
+std::uint32_t Network::getMatchTimeMs() const {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return matchTime();
+}
+
+ClockSync Network::getClockSync() const {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return clockSync;
+}
+
+// Ping every peer once per interval and dump the statistics every few intervals
+void Network::scheduleStatsTick() {
+    statsTimer.expires_after(PING_INTERVAL);
+    statsTimer.async_wait([this](const boost::system::error_code& error) {
+        if (error) {
             return;
         }
-        gameStarted = true;
-        log("Received START_GAME. Transitioning to game mode...");
+        sendPings();
+        evictSilentPeers();
+        if (++statsTicks % STATS_DUMP_EVERY == 0) {
+            dumpStats();
+        }
+        scheduleStatsTick();
+    });
+}
 
-        if (onGameStartCallback) {
-            onGameStartCallback();
+void Network::sendPings() {
+    for (PeerId peer : connectedPeers) {
+        if (peers.endpoint(peer) != selfEndpoint) {
+            sendPing(peer);
         }
+    }
+}
+
+void Network::sendPing(PeerId peer) {
+    std::string payload;
+    appendU32(payload, elapsedMs());
+    queueMessage(Opcode::Ping, payload, peer);
+}
+
+// PONG echoes the ping time and tells the sender how many of its packets
+// arrived and how many were lost, which drives its send rate. Our match
+// time rides along for the clock of a client pinging its host.
+void Network::handlePing(PeerId sender, std::string_view payload) {
+    if (payload.size() < 4) {
+        return;
+    }
+    std::string reply(payload.substr(0, 4));
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        const PeerStats& stats = peerStats[sender];
+        appendU32(reply, static_cast<std::uint32_t>(stats.packetsIn - stats.packetsDuplicated));
+        appendU32(reply, static_cast<std::uint32_t>(stats.packetsLost));
+        appendU32(reply, matchTime());
+    }
+    queueMessage(Opcode::Pong, reply, sender);
+}
+
+void Network::handlePong(PeerId sender, std::string_view payload) {
+    if (payload.size() < 4) {
+        return;
+    }
+    std::uint32_t now = elapsedMs();
+    std::uint32_t sentAt = readU32(payload.data());
+    std::lock_guard<std::mutex> lock(statsMutex);
+    PeerStats& stats = peerStats[sender];
+    stats.onRttSample(static_cast<double>(now - sentAt));
+    if (payload.size() < 12) {
+        return;
+    }
+
+    // Loss over the last ping interval, from the counters the peer reported
+    PeerSender& peer = peerSenders[sender];
+    std::uint32_t received = readU32(payload.data() + 4);
+    std::uint32_t lost = readU32(payload.data() + 8);
+    std::uint32_t newReceived = received - peer.reportedReceived;
+    // Late packets can lower the peer's lost count between two reports
+    auto lostChange = static_cast<std::int32_t>(lost - peer.reportedLost);
+    std::uint32_t newLost = lostChange > 0 ? static_cast<std::uint32_t>(lostChange) : 0;
+    peer.reportedReceived = received;
+    peer.reportedLost = lost;
+    double loss = newReceived + newLost ? static_cast<double>(newLost) / (newReceived + newLost) : 0.0;
+
+    peer.rate.onFeedback(loss, stats.smoothedRttMs, now);
+    stats.remoteLossRate = loss;
+    stats.sendRateBytes = peer.rate.rate();
+    if (sender != clockPeer || payload.size() < 16) {
+        return;
+    }
+
+    // Follow the host's clock, pinging again at once until there are enough samples
+    bool wasSynced = clockSync.synced();
+    clockSync.addSample(sentAt, readU32(payload.data() + 12), now);
+    if (!clockSync.synced()) {
+        sendPing(sender);
+    } else if (!wasSynced) {
+        log("Match clock synced to host, offset " + std::to_string(clockSync.offsetMs()) +
+            " ms, best RTT " + std::to_string(clockSync.bestRttMs()) + " ms");
+    }
+}
+
+void Network::handleFragment(PeerId sender, std::string_view payload) {
+    Opcode opcode;
+    std::string message;
+    std::size_t droppedBefore = reassembler.dropped();
+    bool complete = reassembler.add(peers.endpoint(sender), payload, elapsedMs(), opcode, message);
+    if (reassembler.dropped() != droppedBefore) {
+        log("Dropped " + std::to_string(reassembler.dropped() - droppedBefore) + " incomplete fragmented messages");
+    }
+    if (complete) {
+        if (opcode == Opcode::Fragment) {
+            log("Nested fragment from " + formatEndpoint(peers.endpoint(sender)));
+            return;
+        }
+        dispatchFrame(sender, opcode, message);
+    }
+}
+
+// Append the statistics of every peer to logs/<time>_netstats.csv
+void Network::dumpStats() {
+    if (!statsFile.is_open()) {
+        auto t = std::time(nullptr);
+        auto tm = *std::localtime(&t);
+        std::ostringstream path;
+        path << "logs/" << std::put_time(&tm, "%Y-%m-%d_%H-%M-%S") << "_netstats.csv";
+        statsFile.open(path.str(), std::ios::out | std::ios::trunc);
+        if (!statsFile) {
+            log("Failed to open stats file: " + path.str());
+            return;
+        }
+        writeStatsHeader(statsFile);
+    }
+
+    std::uint32_t now = elapsedMs();
+    std::lock_guard<std::mutex> lock(statsMutex);
+    for (std::size_t peer = 0; peer < peers.limit(); ++peer) {
+        if (!peers.contains(static_cast<PeerId>(peer))) {
+            continue;
+        }
+        writeStatsRow(statsFile, now, formatEndpoint(peers.endpoint(static_cast<PeerId>(peer))), peerStats[peer]);
+    }
+
+    // The local frame times tell a slow client apart from a slow network
+    statsFile << now << ",frame_time,," << frameTimes.mean() << "," << frameTimes.min() << ","
+              << frameTimes.percentile(0.5) << "," << frameTimes.percentile(0.95) << "," << frameTimes.max()
+              << ",,,,,,,,,,,,,,\n";
+    statsFile.flush();
+}
+
+std::vector<std::pair<std::string, PeerStats>> Network::getPeerStats() const {
+    std::vector<std::pair<std::string, PeerStats>> result;
+    std::lock_guard<std::mutex> lock(statsMutex);
+    result.reserve(peers.size());
+    for (std::size_t peer = 0; peer < peers.limit(); ++peer) {
+        if (!peers.contains(static_cast<PeerId>(peer))) {
+            continue;
+        }
+        result.emplace_back(formatEndpoint(peers.endpoint(static_cast<PeerId>(peer))), peerStats[peer]);
+    }
+    return result;
+}
+
+bool Network::getPeerStats(PeerId peer, PeerStats& stats) const {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    if (!peers.contains(peer)) {
+        return false;
+    }
+    stats = peerStats[peer];
+    return true;
+}
+
+std::string Network::getPeerName(PeerId peer) const {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return peers.contains(peer) ? formatEndpoint(peers.endpoint(peer)) : std::string();
+}
+
+void Network::recordFrameTime(double ms) {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    frameTimes.add(ms);
+}
+
+LatencyHistogram Network::getFrameTimeStats() const {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return frameTimes;
+}
+
+void Network::handleNewClient(PeerId, std::string_view payload) {
+    boost::asio::ip::udp::endpoint newClientEndpoint;
+    if (!parseEndpoint(payload, newClientEndpoint)) {
+        log("Malformed NEW_CLIENT endpoint.");
+        return;
+    }
+    PeerId peer = peerId(newClientEndpoint);
+    if (peer != NO_PEER && !members[peer].connected) {
+        addConnectedPeer(peer);
+        log("New client added to connected peers: " + formatEndpoint(newClientEndpoint));
+    }
+}
+
+void Network::handleGameState(PeerId sender, std::string_view payload) {
+    if (gameStarted && notifyGameStateCallback) {
+        notifyGameStateCallback(sender, payload);
+    }
+}
+
+void Network::handleInputs(PeerId sender, std::string_view payload) {
+    if (gameStarted && notifyInputsCallback) {
+        notifyInputsCallback(sender, payload);
+    }
+}
+
+// The endpoint is the one startListening bound, so any port works
+void Network::initializeEndPoints(){
+    boost::asio::ip::udp::endpoint endpoint = selfEndpoint;
+    boost::asio::post(networkStrand, [this, endpoint]() {
+        clearConnectedPeers();
+        addConnectedPeer(peerId(endpoint));
+    });
+}
+
+void Network::handleStartGame(PeerId, std::string_view payload) {
+    if (gameStarted) {
+        log("Game already started. Ignoring duplicate START_GAME message.");
+        return;
+    }
+    startTick = payload.size() >= 4 ? readU32(payload.data()) : 0;
+    gameStarted = true;
+    log("Received START_GAME for tick " + std::to_string(startTick.load()) + ". Transitioning to game mode...");
+
+    if (onGameStartCallback) {
+        onGameStartCallback();
+    }
+    {
+        std::lock_guard<std::mutex> lock(roomViewMutex);
         if (roomView) {
             roomView->quitRendering();
         }
-        log("RoomView quit rendering.");
+    }
+    log("RoomView quit rendering.");
+}
 
-        return;
-    } 
+void Network::handleRoomAnnounce(PeerId, std::string_view payload) {
     // Notify listeners
     if (onRoomStateUpdate) {
+        std::string message(payload);
         log("Room update received: " + message);
         std::cout << "Room update received: " + message << std::endl;
         onRoomStateUpdate(message);
     }
 }
 
-bool Network::joinRoom(const std::string& address, int port) {
+bool Network::joinRoom(const std::string& address, int port, const std::string& playerName) {
     try {
         boost::asio::ip::udp::endpoint remoteEndpoint(boost::asio::ip::make_address(address), port);
         hostEndpoint = remoteEndpoint;
 
-        // Send request
-        std::string joinMessage = "JOIN_ROOM";
-        socket.send_to(boost::asio::buffer(joinMessage), remoteEndpoint);
+        // Send request, the answer arrives through the receive pool
+        {
+            std::lock_guard<std::mutex> lock(joinMutex);
+            joinPending = true;
+        }
+        sendMessage(Opcode::JoinRoom, playerName, remoteEndpoint);
         log("Joining room at " + address + ":" + std::to_string(port));
 
-        // Accept response
-        char buffer[1024] = {0};
-        boost::asio::ip::udp::endpoint senderEndpoint;
-        size_t bytesReceived = socket.receive_from(boost::asio::buffer(buffer), senderEndpoint);
-
-        // Analyze response
-        std::string response(buffer, bytesReceived);
-        if (response.rfind("PLAYER_LIST:", 0) == 0) {
-            playerList.clear();
-            std::istringstream ss(response.substr(12)); // Skip "PLAYER_LIST:"
-            std::string player;
-            while (std::getline(ss, player, ',')) {
-                playerList.push_back(player);
-            }
-            log("Player list synced successfully.");
-        } else if (response.rfind("ENDPOINT_LIST:", 0) == 0) {
-            connectedEndpoints.clear();
-            std::istringstream ss(response.substr(14)); // Skip "ENDPOINT_LIST:"
-            std::string endpointStr;
-            while (std::getline(ss, endpointStr, ',')) {
-                auto delimiterPos = endpointStr.find(':');
-                std::string ip = endpointStr.substr(0, delimiterPos);
-                int port = std::stoi(endpointStr.substr(delimiterPos + 1));
-                boost::asio::ip::udp::endpoint endpoint(boost::asio::ip::make_address(ip), port);
-                connectedEndpoints.push_back(endpoint);
+        // Wait for the player list of the host
+        {
+            std::unique_lock<std::mutex> lock(joinMutex);
+            if (!joinCondition.wait_for(lock, JOIN_TIMEOUT, [this]() { return !joinPending; })) {
+                joinPending = false;
+                log("No answer from host at " + address);
+                return false;
             }
-            log("Connected endpoints synced successfully.");
-        } else {
-            log("Unexpected message from host: " + response);
-            return false;
         }
+        log("Player list synced successfully.");
 
+        // The host's clock becomes the match clock
+        boost::asio::post(networkStrand, [this, remoteEndpoint]() {
+            PeerId host = peerId(remoteEndpoint);
+            {
+                std::lock_guard<std::mutex> lock(statsMutex);
+                clockPeer = host;
+                clockSync.reset();
+            }
+            if (host != NO_PEER) {
+                sendPing(host);
+            }
+        });
         broadcastPlayerList();
 
         return true;
@@ -166,46 +719,69 @@ bool Network::joinRoom(const std::string& address, int port) {
     }
 }
 
-void Network::handleJoinRoomRequest(const boost::asio::ip::udp::endpoint& clientEndpoint, const std::string& message) {
-    if (message == "JOIN_ROOM") {
-        // Add new client to connectedEndpoints
-        if (std::find(connectedEndpoints.begin(), connectedEndpoints.end(), clientEndpoint) == connectedEndpoints.end()) {
-            connectedEndpoints.push_back(clientEndpoint);
-            log("Added new client to connectedEndpoints: " + clientEndpoint.address().to_string() + ":" + std::to_string(clientEndpoint.port()));
+void Network::handleEndpointList(PeerId, std::string_view payload) {
+    clearConnectedPeers();
+    forEachListItem(payload, [this](std::string_view endpointStr) {
+        boost::asio::ip::udp::endpoint endpoint;
+        if (parseEndpoint(endpointStr, endpoint)) {
+            addConnectedPeer(peerId(endpoint));
         }
+    });
+    log("Connected endpoints synced successfully.");
+}
 
-        // Broadcast player list to all clients
-        std::string playerListMessage = "PLAYER_LIST:";
-        for (const auto& player : playerList) {
-            playerListMessage += player + ",";
-        }
-        if (!playerList.empty()) {
-            playerListMessage.pop_back(); // Remove trailing comma
-        }
-        socket.send_to(boost::asio::buffer(playerListMessage), clientEndpoint);
-        log("Sent player list to new client: " + playerListMessage);
+void Network::handleJoinRoomRequest(PeerId client, std::string_view playerName) {
+    // Add new client to the connected peers
+    const boost::asio::ip::udp::endpoint& clientEndpoint = peers.endpoint(client);
+    if (!members[client].connected) {
+        addConnectedPeer(client);
+        log("Added new client to connected peers: " + formatEndpoint(clientEndpoint));
+    } else if (!members[client].playerName.empty()) {
+        // Restarted before it timed out, it adds its player again once it has the list
+        std::string removed;
+        removePlayerEntry(members[client].playerName, removed);
+        refreshRoomView();
+        notifyPeerLeft(client);
+    }
+    members[client].playerName = playerName;
+    members[client].evictedEntry.clear();
 
-        // Broadcast connected endpoints to all clients
-        std::string endpointListMessage = "ENDPOINT_LIST:";
-        for (const auto& endpoint : connectedEndpoints) {
-            endpointListMessage += endpoint.address().to_string() + ":" + std::to_string(endpoint.port()) + ",";
-        }
-        if (!connectedEndpoints.empty()) {
-            endpointListMessage.pop_back(); // Remove trailing comma
-        }
-        socket.send_to(boost::asio::buffer(endpointListMessage), clientEndpoint);
-        log("Sent endpoint list to new client: " + endpointListMessage);
+    // A client that restarted during the game goes straight back into it,
+    // the start arrives before the player list that completes its join
+    if (gameStarted) {
+        std::string start;
+        appendU32(start, startTick);
+        queueMessage(Opcode::StartGame, start, client);
+    }
 
-        // Broadcast new client to all other clients
-        std::string newClientMessage = "NEW_CLIENT:" + clientEndpoint.address().to_string() + ":" + std::to_string(clientEndpoint.port());
-        for (const auto& endpoint : connectedEndpoints) {
-            if (endpoint != clientEndpoint) { // 不向新客户端重复发送
-                socket.send_to(boost::asio::buffer(newClientMessage), endpoint);
-                log("Broadcasted new client to: " + endpoint.address().to_string() + ":" + std::to_string(endpoint.port()));
-            }
+    // Send player list to the new client
+    std::string playerListMessage = buildPlayerListMessage();
+    queueMessage(Opcode::PlayerList, playerListMessage, client);
+    log("Sent player list to new client: " + playerListMessage);
+
+    // Send connected endpoints to the new client
+    std::string endpointListMessage;
+    for (PeerId peer : connectedPeers) {
+        endpointListMessage += formatEndpoint(peers.endpoint(peer)) + ",";
+    }
+    if (!connectedPeers.empty()) {
+        endpointListMessage.pop_back(); // Remove trailing comma
+    }
+    queueMessage(Opcode::EndpointList, endpointListMessage, client);
+    log("Sent endpoint list to new client: " + endpointListMessage);
+
+    // Broadcast new client to all other clients
+    std::string newClientMessage = formatEndpoint(clientEndpoint);
+    for (PeerId peer : connectedPeers) {
+        if (peer != client) { // 不向新客户端重复发送
+            queueMessage(Opcode::NewClient, newClientMessage, peer);
+            log("Broadcasted new client to: " + formatEndpoint(peers.endpoint(peer)));
         }
+    }
 
-        broadcastPlayerList();
+    broadcastPlayerList();
+    if (gameStarted) {
+        resendGameState(client);
     }
 }
 
@@ -222,7 +798,7 @@ void Network::broadcastRoomState(const std::string& message, int port) {
             if (!error) {
                 // Broadcast only if the game has not started
                 if(!gameStarted){
-                    socket.send_to(boost::asio::buffer(message), broadcastEndpoint);
+                    sendMessage(Opcode::RoomAnnounce, message, broadcastEndpoint);
                     log("Broadcast message sent: " + message);
 
                     timer->expires_after(std::chrono::seconds(2));
@@ -291,55 +867,82 @@ std::string Network::getLocalIPAddress() {
 }
 
 void Network::addPlayer(const std::string& playerName) {
-    playerList.push_back(playerName);
+    {
+        std::lock_guard<std::mutex> lock(playerListMutex);
+        playerList.push_back(playerName);
+    }
     broadcastPlayerList();
 }
 
 void Network::removePlayer(const std::string& playerName) {
-    playerList.erase(std::remove(playerList.begin(), playerList.end(), playerName), playerList.end());
+    {
+        std::lock_guard<std::mutex> lock(playerListMutex);
+        playerList.erase(std::remove(playerList.begin(), playerList.end(), playerName), playerList.end());
+    }
     broadcastPlayerList();
 }
 
-void Network::broadcastPlayerList() {
-    std::string listMessage = "PLAYER_LIST:";
+std::string Network::buildPlayerListMessage() const {
+    std::lock_guard<std::mutex> lock(playerListMutex);
+    std::string listMessage;
     for (const auto& player : playerList) {
         listMessage += player + ",";
     }
     if (!playerList.empty()) {
-        listMessage.pop_back();
-    }
-    for (const auto& endpoint : connectedEndpoints) {
-        socket.send_to(boost::asio::buffer(listMessage), endpoint);
-        log("Broadcasted player list to: " + endpoint.address().to_string() + ":" + std::to_string(endpoint.port()));
+        listMessage.pop_back(); // Remove trailing comma
     }
+    return listMessage;
+}
+
+// connectedPeers only changes on the strand, so the loops over it run there too
+// Runs inline when called from a handler, so it shares that handler's datagrams
+void Network::broadcastPlayerList() {
+    boost::asio::dispatch(networkStrand, [this, listMessage = buildPlayerListMessage()]() {
+        for (PeerId peer : connectedPeers) {
+            queueMessage(Opcode::PlayerList, listMessage, peer);
+            log("Broadcasted player list to: " + formatEndpoint(peers.endpoint(peer)));
+        }
+    });
 }
 
 void Network::syncPlayerList(const boost::asio::ip::udp::endpoint& target) {
-    std::string listMessage = "PLAYER_LIST:";
-    for (const auto& player : playerList) {
-        listMessage += player + ",";
-    }
-    listMessage.pop_back(); // Remove trailing comma
+    std::string listMessage = buildPlayerListMessage();
     log(listMessage);
-    socket.send_to(boost::asio::buffer(listMessage), target);
+    sendMessage(Opcode::PlayerList, listMessage, target);
 }
 
 // Handle player list updates
-void Network::handlePlayerListUpdate(const std::string& message) {
-    if (message.rfind("PLAYER_LIST:", 0) == 0) {
-        playerList.clear();
-        std::istringstream ss(message.substr(12)); // Skip "PLAYER_LIST:"
-        std::string player;
-        while (std::getline(ss, player, ',')) {
-            playerList.push_back(player);
-        }
-        log("Player list updated: " + message);
+void Network::handlePlayerListUpdate(PeerId sender, std::string_view payload) {
+    // The host is in its own endpoint list, the echo of its broadcast may be older than what we have
+    if (peers.endpoint(sender) == selfEndpoint) {
+        return;
+    }
+    std::vector<std::string> players;
+    forEachListItem(payload, [&players](std::string_view player) {
+        players.emplace_back(player);
+    });
+    {
+        std::lock_guard<std::mutex> lock(playerListMutex);
+        playerList = players;
+    }
+    log("Player list updated: " + std::string(payload));
+    {
+        std::lock_guard<std::mutex> lock(roomViewMutex);
         if (roomView) {
-            roomView->updatePlayers(playerList);
+            roomView->updatePlayers(players);
         } else {
             log("roomView is not initialized.");
         }
     }
+
+    // The first player list answers a pending join request
+    {
+        std::lock_guard<std::mutex> lock(joinMutex);
+        if (joinPending) {
+            joinPending = false;
+            joinCondition.notify_all();
+        }
+    }
     log("Done.");
 }
 
@@ -348,9 +951,17 @@ boost::asio::ip::udp::endpoint Network::getHostEndpoint() const {
 }
 
 std::vector<std::string> Network::getPlayerList() const {
+    std::lock_guard<std::mutex> lock(playerListMutex);
     return playerList;
 }
 
+// Delete the room view once the network thread can no longer reach it
+void Network::releaseRoomView() {
+    std::lock_guard<std::mutex> lock(roomViewMutex);
+    delete roomView;
+    roomView = nullptr;
+}
+
 // Initialize the room view for the network, the callbacks for the buttons
 void Network::initializeRoomView(SDL_Renderer* renderer, bool isHost, const std::string& playerName) {
     roomView = new RoomView(renderer, isHost);
@@ -367,7 +978,7 @@ void Network::initializeRoomView(SDL_Renderer* renderer, bool isHost, const std:
         handleReadyState(message);
         broadcastPlayerList();
         if (roomView) {
-            roomView->updatePlayers(playerList);  // 刷新玩家列表显示
+            roomView->updatePlayers(getPlayerList());  // 刷新玩家列表显示
         }
         log(playerName + (isReady ? " is ready." : " canceled ready."));
     });
@@ -387,6 +998,7 @@ void Network::initializeRoomView(SDL_Renderer* renderer, bool isHost, const std:
 }
 
 void Network::handleReadyState(const std::string& message) {
+    std::lock_guard<std::mutex> lock(playerListMutex);
     if (message.rfind("READY:", 0) == 0) {
         std::string playerName = message.substr(6);
         auto it = std::find(playerList.begin(), playerList.end(), playerName);
@@ -407,22 +1019,33 @@ void Network::startGameSession() {
         log("Warning: No game state callback set. State updates may be ignored.");
     }
     if (!gameSessionStarted) {
-        std::string startMessage = "START_GAME";
-        for (const auto& endpoint : connectedEndpoints) {
-            socket.send_to(boost::asio::buffer(startMessage), endpoint);
-            log("Sent START_GAME to: " + endpoint.address().to_string() + ":" + std::to_string(endpoint.port()));
-        }
+        // Far enough ahead that every client has the message before the tick
+        // comes, set here as well since our own copy may arrive after the game is shown
+        startTick = getMatchTick() + START_LEAD_TICKS;
+        boost::asio::post(networkStrand, [this]() {
+            std::string start;
+            appendU32(start, startTick);
+            for (PeerId peer : connectedPeers) {
+                queueMessage(Opcode::StartGame, start, peer);
+                log("Sent START_GAME to: " + formatEndpoint(peers.endpoint(peer)));
+            }
+        });
         gameSessionStarted = true;
         log("Game session started.");
     }
 }
 
-void Network::setNotifyGameStateCallback(const std::function<void(const std::string&, const std::string&)>& callback) {
+void Network::setNotifyGameStateCallback(const std::function<void(PeerId, std::string_view)>& callback) {
     notifyGameStateCallback = callback;
     log("Game state callback set.");
 }
 
+void Network::setNotifyInputsCallback(const std::function<void(PeerId, std::string_view)>& callback) {
+    notifyInputsCallback = callback;
+}
+
 bool Network::allPlayersReady() const {
+    std::lock_guard<std::mutex> lock(playerListMutex);
     for (const auto& player : playerList) {
         if (player.find("(Ready)") == std::string::npos) {
             return false;
@@ -431,28 +1054,81 @@ bool Network::allPlayersReady() const {
     return true;
 }
 
+// Only the newest state matters: it replaces one that is still waiting for
+// its peer's budget, and goes out once the rate controller allows it
 void Network::broadcastGameState(const std::string& state) {
-    for (const auto& endpoint : connectedEndpoints) {
-        socket.send_to(boost::asio::buffer(state), endpoint);
-    }
-    log("Broadcasted game state: " + state);
+    boost::asio::post(networkStrand, [this, state]() {
+        latestState = state;
+        std::lock_guard<std::mutex> lock(statsMutex);
+        for (PeerId peer : connectedPeers) {
+            PeerSender& sender = peerSenders[peer];
+            if (sender.statePending) {
+                ++peerStats[peer].statesSuperseded;
+            }
+            sender.statePending = true;
+        }
+        flushGameState();
+    });
 }
 
-// Receive game state updates from all clients
-std::vector<std::pair<std::string, std::string>> Network::receiveGameStateUpdates() {
-    std::vector<std::pair<std::string, std::string>> updates;
-    while (true) {
-        char buffer[1024] = {0};
-        boost::asio::ip::udp::endpoint senderEndpoint;
-        size_t bytesReceived = socket.receive_from(boost::asio::buffer(buffer), senderEndpoint);
-        if (bytesReceived > 0) {
-            std::string state(buffer, bytesReceived);
-            updates.emplace_back(senderEndpoint.address().to_string(), state);
+// Inputs are small and every message repeats the last ones, so they skip
+// the pacing and go out with the next flush
+void Network::broadcastInputs(const std::string& inputs) {
+    boost::asio::post(networkStrand, [this, inputs]() {
+        for (PeerId peer : connectedPeers) {
+            if (peers.endpoint(peer) != selfEndpoint) {
+                queueMessage(Opcode::Inputs, inputs, peer);
+            }
+        }
+    });
+}
+
+// On the strand with statsMutex held
+void Network::flushGameState() {
+    std::uint32_t now = elapsedMs();
+    std::size_t bytes = latestState.size() + MESSAGE_HEADER_SIZE;
+    bool waiting = false;
+    for (PeerId peer : connectedPeers) {
+        PeerSender& sender = peerSenders[peer];
+        if (!sender.statePending) {
+            continue;
+        }
+        // Never stack states behind a send the socket has not finished
+        PeerStats& stats = peerStats[peer];
+        if (stats.sendQueueDepth > 0 || !sender.rate.trySend(bytes, now)) {
+            waiting = true;
+            continue;
         }
+        sender.statePending = false;
+        stats.sendRateBytes = sender.rate.rate();
+        queueMessage(Opcode::GameState, latestState, peer);
+    }
+
+    if (waiting && !paceTimerArmed) {
+        paceTimerArmed = true;
+        paceTimer.expires_after(PACE_INTERVAL);
+        paceTimer.async_wait([this](const boost::system::error_code& error) {
+            paceTimerArmed = false;
+            if (error) {
+                return;
+            }
+            std::lock_guard<std::mutex> lock(statsMutex);
+            flushGameState();
+        });
     }
-    return updates;
 }
 
 void Network::setOnGameStartCallback(const std::function<void()>& callback) {
     onGameStartCallback = callback;
+}
+
+void Network::setOnPeerLeftCallback(const std::function<void(PeerId)>& callback) {
+    onPeerLeftCallback = callback;
+}
+
+// On the strand, like the other notifications
+void Network::notifyPeerLeft(PeerId peer) {
+    if (onPeerLeftCallback) {
+        onPeerLeftCallback(peer);
+    }
 }
\ No newline at end of file
@@ -1,10 +1,20 @@
 #include "OnlineGame.h"
+#include <cstring>
 #include <sstream>
 
+static_assert(Game::TICK_MS == MATCH_TICK_MS, "the game must step on the match timeline");
+
 OnlineGame::OnlineGame(SDL_Renderer* renderer, Network* network)
     : Game(renderer), network(network) {
-    network->setNotifyGameStateCallback([this](const std::string& playerId, const std::string& state) {
-        handleRemoteState(playerId, state);
+    slotOfPeer.fill(MAX_REMOTE_PLAYERS);
+    network->setNotifyGameStateCallback([this](PeerId peer, std::string_view state) {
+        handleRemoteState(peer, state);
+    });
+    network->setNotifyInputsCallback([this](PeerId peer, std::string_view payload) {
+        handleRemoteInputs(peer, payload);
+    });
+    network->setOnPeerLeftCallback([this](PeerId peer) {
+        releaseRemoteSlot(peer);
     });
     log("OnlineGame initialized.");
 }
@@ -13,99 +23,334 @@ OnlineGame::~OnlineGame() {}
 
 void OnlineGame::handleInput() {
     Game::handleInput(); 
+    if (rollback && recording.events.size() != inputsSent) {
+        sendInputs();
+    }
     syncState();
 }
 
-void OnlineGame::update(Uint32 deltaTime) {
-    Game::update(deltaTime);
+// Steps follow the match clock instead of the frame time, so every player
+// is on the same tick at the same moment
+void OnlineGame::update(Uint32) {
+    std::int32_t behind = static_cast<std::int32_t>(network->getMatchTick() - tickBase - tick);
+    if (behind > MAX_CATCHUP_TICKS) {
+        tickBase += static_cast<std::uint32_t>(behind - MAX_CATCHUP_TICKS);
+        behind = MAX_CATCHUP_TICKS;
+    }
+    for (; behind > 0 && !gameOver; --behind) {
+        step();
+    }
+    if (rollback) {
+        advanceMirrors();
+    }
+}
+
+// Every mirrored game catches up with the match clock, going back first
+// when inputs arrived for ticks it already simulated
+void OnlineGame::advanceMirrors() {
+    std::uint32_t matchTick = network->getMatchTick();
+    for (auto& slot : remoteSlots) {
+        if (!isShown(slot)) {
+            continue;
+        }
+        RollbackGame& mirror = slot.mirror;
+        if (slot.inputs.update()) {
+            bool wasActive = mirror.active();
+            if (!mirror.addInputs(slot.inputs.latest()) && wasActive) {
+                log("Missed inputs of " + std::string(slot.name.data()) + ", showing its game states instead");
+            }
+        }
+        std::int32_t target = static_cast<std::int32_t>(matchTick - mirror.getTickBase());
+        mirror.advanceTo(static_cast<std::uint32_t>(std::max(target, 0)));
+    }
+}
+
+// Rollback mode: the recent inputs go out at once when there is a new one,
+// and with every state so the others know how far they are complete
+void OnlineGame::sendInputs() {
+    network->broadcastInputs(encodeInputWindow(makeInputWindow(recording, tickBase, tick)));
+    inputsSent = recording.events.size();
 }
 
 void OnlineGame::render() {
     Game::render();
+}
+
+void OnlineGame::renderOverlay() {
     renderOtherPlayers(400, 50, 150, 400); // 右侧状态栏位置
+    if (showNetStats) {
+        renderNetStats(10, 10);
+    }
+}
+
+// F3 toggles the network statistics overlay
+void OnlineGame::handleExtraKey(SDL_Keycode key) {
+    if (key == SDLK_F3) {
+        showNetStats = !showNetStats;
+    }
+}
+
+void OnlineGame::renderNetStats(int x, int y) {
+    SDL_Color textColor = {255, 255, 0, 255};
+    LatencyHistogram frameTimes = network->getFrameTimeStats();
+    char frameLine[96];
+    snprintf(frameLine, sizeof(frameLine), "frame p50 %.0f p95 %.0f max %.0f ms",
+             frameTimes.percentile(0.5), frameTimes.percentile(0.95), frameTimes.max());
+    renderText(frameLine, x, y, 300, 16, textColor);
+
+    ClockSync clock = network->getClockSync();
+    if (clock.synced()) {
+        char clockLine[96];
+        snprintf(clockLine, sizeof(clockLine), "clock %+.1f ms drift %+.0f ppm tick %u",
+                 clock.offsetMs(), clock.driftPpm(), tickBase + tick);
+        y += 18;
+        renderText(clockLine, x, y, 300, 16, textColor);
+    }
+
+    if (rollback) {
+        std::uint64_t rollbacks = 0;
+        std::uint64_t restarts = 0;
+        std::uint32_t deepest = 0;
+        for (const auto& slot : remoteSlots) {
+            rollbacks += slot.mirror.rollbacks();
+            restarts += slot.mirror.fullResimulations();
+            deepest = std::max(deepest, slot.mirror.deepestRollback());
+        }
+        char rollbackLine[96];
+        snprintf(rollbackLine, sizeof(rollbackLine), "rollbacks %llu deepest %u ticks restarts %llu",
+                 static_cast<unsigned long long>(rollbacks), deepest, static_cast<unsigned long long>(restarts));
+        y += 18;
+        renderText(rollbackLine, x, y, 300, 16, textColor);
+    }
+
+    for (const auto& [peer, stats] : network->getPeerStats()) {
+        y += 18;
+        std::string line = formatStatsLine(peer, stats);
+        renderText(line, x, y, static_cast<int>(line.size()) * 7, 16, textColor);
+    }
 }
 
 // Syncronize the game state with other players
 void OnlineGame::syncState() {
+    Uint32 now = SDL_GetTicks();
+    if (now - lastSyncTime < STATE_SEND_INTERVAL_MS) {
+        return;
+    }
+    lastSyncTime = now;
+
     std::ostringstream oss;
-    oss << grid->serialize() << "|" 
-        << currentBlock->serialize() << "|" 
-        << score;
+    oss << grid.serialize() << "|" 
+        << currentBlock.serialize() << "|" 
+        << score << "|"
+        << speed << "|"
+        << network->getMatchTimeMs() << "|"
+        << tickBase + tick;
     network->broadcastGameState(oss.str());
+    if (rollback) {
+        sendInputs();
+    }
+}
+
+// Network thread: find the slot of a player or claim a free one. The
+// first message after a game started lets go of the previous game's slots.
+OnlineGame::RemoteSlot* OnlineGame::findRemoteSlot(PeerId peer) {
+    std::uint32_t generation = gameGeneration.load(std::memory_order_acquire);
+    if (generation != claimGeneration) {
+        claimGeneration = generation;
+        for (const auto& slot : remoteSlots) {
+            if (slot.state.load(std::memory_order_relaxed) == SlotState::Active) {
+                releaseRemoteSlot(slot.peer);
+            }
+        }
+    }
+    if (slotOfPeer[peer] < MAX_REMOTE_PLAYERS) {
+        return &remoteSlots[slotOfPeer[peer]];
+    }
+    for (std::size_t i = 0; i < remoteSlots.size(); ++i) {
+        RemoteSlot& slot = remoteSlots[i];
+        if (slot.state.load(std::memory_order_acquire) == SlotState::Free) {
+            slot.generation = generation;
+            slot.peer = peer;
+            std::strncpy(slot.name.data(), network->getPeerName(peer).c_str(), slot.name.size() - 1);
+            slot.state.store(SlotState::Active, std::memory_order_release);
+            slotOfPeer[peer] = static_cast<std::uint8_t>(i);
+            return &slot;
+        }
+    }
+    return nullptr;
 }
 
-// Handle remote player state updates
-void OnlineGame::handleRemoteState(const std::string& playerId, const std::string& state) {
-    std::istringstream iss(state);
-    std::string gridState, blockState, scoreState;
+// Network thread: nothing is published into the slot after this, the
+// render thread clears it before it can be claimed again
+void OnlineGame::releaseRemoteSlot(PeerId peer) {
+    if (peer >= slotOfPeer.size() || slotOfPeer[peer] >= MAX_REMOTE_PLAYERS) {
+        return;
+    }
+    remoteSlots[slotOfPeer[peer]].state.store(SlotState::Released, std::memory_order_release);
+    slotOfPeer[peer] = MAX_REMOTE_PLAYERS;
+}
 
-    std::getline(iss, gridState, '|');
-    std::getline(iss, blockState, '|');
-    std::getline(iss, scoreState, '|');
+// Render thread: drops what the last player left in a released slot
+void OnlineGame::clearReleasedSlots() {
+    for (auto& slot : remoteSlots) {
+        if (slot.state.load(std::memory_order_acquire) != SlotState::Released) {
+            continue;
+        }
+        slot.latest.update();
+        slot.inputs.update();
+        slot.view = RemotePlayerView();
+        slot.mirror.reset();
+        slot.state.store(SlotState::Free, std::memory_order_release);
+    }
+}
 
-    Grid tempGrid(10, 20);
-    tempGrid.deserialize(gridState);
+// Render thread: slots of players that left, or of an earlier game, are not drawn
+bool OnlineGame::isShown(const RemoteSlot& slot) const {
+    return slot.state.load(std::memory_order_acquire) == SlotState::Active &&
+           slot.generation == gameGeneration.load(std::memory_order_relaxed);
+}
 
-    Block tempBlock;
-    tempBlock.deserialize(blockState);
-    
-    int playerScore = std::stoi(scoreState);
-    
-    // Store the state
-    std::ostringstream renderedState;
-    
-    renderedState << tempGrid.serialize() 
-                  << "|" << tempBlock.serialize() 
-                  << "|" << playerScore;
-    playerStates[playerId] = renderedState.str();
+// Handle remote player state updates, decoded straight into the slot's back buffer
+void OnlineGame::handleRemoteState(PeerId peer, std::string_view state) {
+    RemoteSlot* slot = findRemoteSlot(peer);
+    if (!slot) {
+        return;
+    }
+    TimedSnapshot& snapshot = slot->latest.writeBuffer();
+    if (!parseBoardSnapshot(state, snapshot.board)) {
+        log("Malformed state from " + std::string(slot->name.data()));
+        return;
+    }
+    snapshot.arrivalMs = network->getMatchTimeMs();
+    slot->latest.publish();
+}
+
+// Network thread
+void OnlineGame::handleRemoteInputs(PeerId peer, std::string_view payload) {
+    RemoteSlot* slot = findRemoteSlot(peer);
+    if (!slot) {
+        return;
+    }
+    if (!parseInputWindow(payload, slot->inputs.writeBuffer())) {
+        log("Malformed inputs from " + std::string(slot->name.data()));
+        return;
+    }
+    slot->inputs.publish();
+}
+
+// A mirrored game in the layout the remote views draw
+static BoardSnapshot boardOf(const Game& game) {
+    BoardSnapshot board;
+    const Grid& grid = game.getGrid();
+    for (int y = 0; y < BoardSnapshot::HEIGHT; ++y) {
+        board.rows[y] = grid.getRow(y);
+    }
+    const Block& block = game.getCurrentBlock();
+    const BlockShape& cells = block.getCells();
+    board.pieceHeight = std::min<int>(cells.height, board.pieceRows.size());
+    board.pieceWidth = cells.width;
+    for (int i = 0; i < board.pieceHeight; ++i) {
+        board.pieceRows[i] = cells.rows[i];
+    }
+    board.pieceType = block.getType();
+    board.pieceColor = block.getColor();
+    board.pieceX = block.getX();
+    board.pieceY = block.getY();
+    board.score = game.getScore();
+    return board;
 }
 
 void OnlineGame::renderOtherPlayers(int x, int y, int width, int height) {
-    int playerCount = static_cast<int>(playerStates.size());
+    clearReleasedSlots();
+    int playerCount = 0;
+    for (const auto& slot : remoteSlots) {
+        playerCount += isShown(slot);
+    }
     if (playerCount == 0) return;
-    log("Rendering other players...");
 
     int gridHeight = height / playerCount;
     int gridWidth = width;
-    int cellSize = std::min(gridWidth / 10, gridHeight / 20);
+    int cellSize = std::min(gridWidth / BoardSnapshot::WIDTH, gridHeight / BoardSnapshot::HEIGHT);
     int gridYOffset = y;
 
-    for (const auto& [playerId, state] : playerStates) {
-        Grid tempGrid(10, 20);
-        std::istringstream stateStream(state);
-        std::string gridData, blockData, scoreData;
-        std::getline(stateStream, gridData, '|');
-        tempGrid.deserialize(gridData);
+    // Size each jitter buffer from the RTT measured for that peer, a few times per second
+    Uint32 now = SDL_GetTicks();
+    bool estimate = now - lastEstimateTime >= NETWORK_ESTIMATE_INTERVAL_MS;
+    if (estimate) {
+        lastEstimateTime = now;
+    }
+    Uint32 matchNow = network->getMatchTimeMs();
+
+    for (auto& slot : remoteSlots) {
+        if (!isShown(slot)) {
+            continue;
+        }
+        const char* playerId = slot.name.data();
+        RemotePlayerView& view = slot.view;
+        if (slot.latest.update()) {
+            view.push(slot.latest.latest().board, slot.latest.latest().arrivalMs);
+        }
+
+        PeerStats stats;
+        if (estimate && network->getPeerStats(slot.peer, stats)) {
+            view.setNetworkEstimate(stats.smoothedRttMs, stats.jitterMs);
+        }
+
+        BoardSnapshot board;
+        float pieceX, pieceY;
+        if (rollback && slot.mirror.active()) {
+            board = boardOf(slot.mirror.game());
+            pieceX = static_cast<float>(board.pieceX);
+            pieceY = static_cast<float>(board.pieceY);
+        } else if (!view.sample(matchNow, board, pieceX, pieceY)) {
+            continue;
+        }
 
         // Background
         SDL_Rect gridBackground = {x, gridYOffset, gridWidth, gridHeight};
         SDL_SetRenderDrawColor(renderer, 25, 25, 25, 255);
         SDL_RenderFillRect(renderer, &gridBackground);
 
-        // Blocks
-        const auto& gridMatrix = tempGrid.getGrid();
-        const auto& gridColors = tempGrid.getGridColors();
-        for (int i = 0; i < tempGrid.getHeight(); ++i) {
-            for (int j = 0; j < tempGrid.getWidth(); ++j) {
-                if (gridMatrix[i][j]) {
+        // Settled blocks, colors are not sent so they are drawn in grey
+        SDL_SetRenderDrawColor(renderer, 150, 150, 150, 255);
+        for (int i = 0; i < BoardSnapshot::HEIGHT; ++i) {
+            for (int j = 0; j < BoardSnapshot::WIDTH; ++j) {
+                if (board.rows[i] & (1u << j)) {
                     SDL_Rect rect = {
                         x + j * cellSize,
                         gridYOffset + i * cellSize,
                         cellSize,
                         cellSize
                     };
-                    int color = gridColors[i][j];
-                    SDL_SetRenderDrawColor(renderer, (color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF, 255);
                     SDL_RenderFillRect(renderer, &rect);
                 }
             }
         }
 
+        // Falling piece at its interpolated position
+        int color = board.pieceColor;
+        SDL_SetRenderDrawColor(renderer, (color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF, 255);
+        for (int i = 0; i < board.pieceHeight; ++i) {
+            for (int j = 0; j < board.pieceWidth; ++j) {
+                if (board.pieceRows[i] & (1u << j)) {
+                    SDL_Rect rect = {
+                        x + static_cast<int>((pieceX + j) * cellSize),
+                        gridYOffset + static_cast<int>((pieceY + i) * cellSize),
+                        cellSize,
+                        cellSize
+                    };
+                    if (rect.y >= gridYOffset) {
+                        SDL_RenderFillRect(renderer, &rect);
+                    }
+                }
+            }
+        }
+
         // Player name
         TTF_Font* font = TTF_OpenFont("fonts/arial.ttf", 16);
         if (font) {
             SDL_Color textColor = {255, 255, 255, 255};
-            SDL_Surface* textSurface = TTF_RenderText_Solid(font, playerId.c_str(), textColor);
+            SDL_Surface* textSurface = TTF_RenderText_Solid(font, playerId, textColor);
             if (textSurface) {
                 SDL_Texture* textTexture = SDL_CreateTextureFromSurface(renderer, textSurface);
                 SDL_Rect textRect = {x + 5, gridYOffset + 5, textSurface->w, textSurface->h};
@@ -121,19 +366,40 @@ void OnlineGame::renderOtherPlayers(int x, int y, int width, int height) {
     }
 }
 
+// Everyone starts on the tick from START_GAME. A player that joins a game
+// already running starts on the current tick instead.
+void OnlineGame::waitForStart() {
+    Uint32 waitStart = SDL_GetTicks();
+    std::uint32_t startTick = network->getStartTick();
+    while (static_cast<std::int32_t>(network->getMatchTick() - startTick) < 0 &&
+           SDL_GetTicks() - waitStart < MAX_START_WAIT_MS) {
+        SDL_PumpEvents();
+        render();
+        SDL_Delay(1);
+    }
+    std::uint32_t now = network->getMatchTick();
+    std::int32_t late = static_cast<std::int32_t>(now - startTick);
+    tickBase = late >= 0 && late <= MAX_CATCHUP_TICKS ? startTick : now;
+}
+
 void OnlineGame::show() {
     if(gameStarted){
         return;
     }
     gameStarted = true;
+    gameGeneration.fetch_add(1, std::memory_order_release);
     reset();
+    inputsSent = 0;
+    waitForStart();
     Uint32 lastTime = SDL_GetTicks();
     while (!quit) {
         Uint32 currentTime = SDL_GetTicks();
         Uint32 deltaTime = currentTime - lastTime;
         lastTime = currentTime;
+        network->recordFrameTime(deltaTime);
         handleInput();
         if (gameOver) {
+            saveRecording();
             renderGameOver();
             gameStarted = false;
             return;
@@ -143,4 +409,6 @@ void OnlineGame::show() {
         
         SDL_Delay(16);
     }
+    saveRecording();
+    gameStarted = false;
 }
\ No newline at end of file
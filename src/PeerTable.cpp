@@ -0,0 +1,83 @@
+#include "PeerTable.h"
+#include <algorithm>
+
+PeerTable::PeerTable() {
+    slots.fill(NO_PEER);
+}
+
+PeerId PeerTable::find(const boost::asio::ip::udp::endpoint& endpoint) const {
+    for (std::size_t slot = hash(endpoint);; slot = (slot + 1) & (SLOTS - 1)) {
+        PeerId id = slots[slot];
+        if (id == NO_PEER) {
+            return NO_PEER;
+        }
+        if (endpoints[id] == endpoint) {
+            return id;
+        }
+    }
+}
+
+PeerId PeerTable::insert(const boost::asio::ip::udp::endpoint& endpoint) {
+    std::size_t slot = hash(endpoint);
+    for (; slots[slot] != NO_PEER; slot = (slot + 1) & (SLOTS - 1)) {
+        if (endpoints[slots[slot]] == endpoint) {
+            return slots[slot];
+        }
+    }
+    if (count == MAX_PEERS) {
+        return NO_PEER;
+    }
+    PeerId id = 0;
+    while (used[id]) {
+        ++id;
+    }
+    used[id] = true;
+    ++count;
+    idLimit = std::max<std::size_t>(idLimit, id + 1);
+    endpoints[id] = endpoint;
+    slots[slot] = id;
+    return id;
+}
+
+// Backward shift deletion: later entries of the probe chain move up into
+// the hole, so lookups never need tombstones
+void PeerTable::erase(PeerId id) {
+    if (!contains(id)) {
+        return;
+    }
+    std::size_t hole = hash(endpoints[id]);
+    while (slots[hole] != id) {
+        hole = (hole + 1) & (SLOTS - 1);
+    }
+    for (std::size_t slot = (hole + 1) & (SLOTS - 1); slots[slot] != NO_PEER; slot = (slot + 1) & (SLOTS - 1)) {
+        // An entry may fill the hole if its home slot is not between the hole and itself
+        std::size_t home = hash(endpoints[slots[slot]]);
+        if (((slot - home) & (SLOTS - 1)) >= ((slot - hole) & (SLOTS - 1))) {
+            slots[hole] = slots[slot];
+            hole = slot;
+        }
+    }
+    slots[hole] = NO_PEER;
+
+    used[id] = false;
+    --count;
+    while (idLimit > 0 && !used[idLimit - 1]) {
+        --idLimit;
+    }
+}
+
+// Fibonacci hashing of address and port, the top bits pick the slot
+std::size_t PeerTable::hash(const boost::asio::ip::udp::endpoint& endpoint) {
+    std::uint64_t key = endpoint.port();
+    const auto& address = endpoint.address();
+    if (address.is_v4()) {
+        key |= static_cast<std::uint64_t>(address.to_v4().to_uint()) << 16;
+    } else {
+        for (unsigned char byte : address.to_v6().to_bytes()) {
+            key = (key ^ byte) * 0x100000001B3ull;
+        }
+    }
+    constexpr int SLOT_BITS = 9;
+    static_assert(std::size_t{1} << SLOT_BITS == SLOTS, "SLOT_BITS must match the slot count");
+    return static_cast<std::size_t>((key * 0x9E3779B97F4A7C15ull) >> (64 - SLOT_BITS));
+}
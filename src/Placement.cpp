@@ -0,0 +1,232 @@
+#include "Placement.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+static constexpr std::uint64_t LANES = 0x0001000100010001ull;
+
+// Four 16 bit rows as one word
+static std::uint64_t loadRows(const std::uint16_t* rows) {
+    std::uint64_t word;
+    std::memcpy(&word, rows, sizeof word);
+    return word;
+}
+
+// Moves every lane one column, bits do not cross into the next lane
+static std::uint64_t shiftLeft(std::uint64_t lanes, int columns) {
+    return (lanes << columns) & (((0xFFFFu << columns) & 0xFFFFu) * LANES);
+}
+
+static std::uint64_t shiftRight(std::uint64_t lanes, int columns) {
+    return (lanes >> columns) & ((0xFFFFu >> columns) * LANES);
+}
+
+// Extends the seeds sideways over the open cells of each lane, both
+// directions in four doubling steps each
+static std::uint64_t fillSideways(std::uint64_t seed, std::uint64_t open) {
+    std::uint64_t left = seed;
+    std::uint64_t right = seed;
+    std::uint64_t leftOpen = open;
+    std::uint64_t rightOpen = open;
+    for (int columns = 1; columns < Grid::MAX_WIDTH; columns <<= 1) {
+        right |= rightOpen & shiftLeft(right, columns);
+        rightOpen &= shiftLeft(rightOpen, columns);
+        left |= leftOpen & shiftRight(left, columns);
+        leftOpen &= shiftRight(leftOpen, columns);
+    }
+    return left | right;
+}
+
+// Lane r moves to lane r + 1, one clockwise turn
+static std::uint64_t rotateLanes(std::uint64_t lanes) {
+    return std::rotl(lanes, 16);
+}
+
+std::size_t PlacementFinder::find(const Grid& grid, BlockType type) {
+    return find(grid, Block(type, 0, Block::SPAWN_X, Block::SPAWN_Y, 0));
+}
+
+std::size_t PlacementFinder::find(const Grid& grid, const Block& piece) {
+    type = piece.getType();
+    height = grid.getHeight();
+    start = piece;
+    count = 0;
+    computeFits(grid);
+
+    int startX = piece.getX();
+    int startY = piece.getY();
+    if (startX < 0 || startX >= Grid::MAX_WIDTH || startY < 0 || startY >= height) {
+        return 0;
+    }
+    std::uint64_t above = 0;
+    std::uint64_t row = (std::uint64_t{1} << (16 * piece.getRotation() + startX)) & fits[startY];
+    int bottom = startY - 1;   // Last row reached
+    for (int y = startY; y < height && row; ++y) {
+        // Sideways and around until the row stops growing
+        while (row != fits[y]) {
+            std::uint64_t grown = fillSideways(row, fits[y]);
+            grown |= rotateLanes(grown) & fits[y];
+            if (grown == row) {
+                break;
+            }
+            row = grown;
+        }
+        reached[y] = row;
+        bottom = y;
+        above = row;
+        row = above & fits[y + 1];
+    }
+
+    // Positions that can not move down are resting places, a rotation with
+    // the same cells as an earlier one only adds those the earlier missed
+    std::uint64_t unique = 0;
+    for (int rotation = 0; rotation < 4; ++rotation) {
+        if (sameCellsAs[rotation] == rotation) {
+            unique |= std::uint64_t{0xFFFF} << (16 * rotation);
+        }
+    }
+    for (int y = startY; y <= bottom; ++y) {
+        std::uint64_t resting = reached[y] & ~fits[y + 1];
+        std::uint64_t repeated = resting & ~unique;
+        resting &= unique;
+        for (int rotation = 0; repeated && rotation < 4; ++rotation) {
+            std::uint64_t lane = (repeated >> (16 * rotation)) & 0xFFFF;
+            std::uint64_t earlier = (resting >> (16 * sameCellsAs[rotation])) & 0xFFFF;
+            resting |= (lane & ~earlier) << (16 * rotation);
+        }
+        for (; resting; resting &= resting - 1) {
+            int bit = std::countr_zero(resting);
+            placements[count++] = {static_cast<std::int8_t>(bit % 16), static_cast<std::int8_t>(y),
+                                   static_cast<std::uint8_t>(bit / 16)};
+        }
+    }
+    return count;
+}
+
+// A piece row blocks x when a filled cell sits under one of its cells, so
+// all x are tested at once by shifting the grid row right by each cell's
+// column. Four grid rows fit in one word and are shifted together, and
+// each distinct piece row is slid over the grid once for all rotations.
+// Above the stack nothing blocks, those rows are not looked at.
+void PlacementFinder::computeFits(const Grid& grid) {
+    const auto& rows = grid.getRows();
+    int stackTop = 0;
+    while (stackTop < height && !rows[stackTop]) {
+        ++stackTop;
+    }
+    int firstRow = std::max(0, stackTop - 3) & ~3;
+
+    // Below the grid every cell counts as filled, like the floor
+    std::array<std::uint16_t, PADDED_HEIGHT> padded;
+    std::fill(padded.begin() + height, padded.end(), 0xFFFF);
+    std::copy(rows.begin() + firstRow, rows.begin() + height, padded.begin() + firstRow);
+
+    std::array<std::array<std::uint16_t, PADDED_HEIGHT>, 16> blockedBy;
+    unsigned int slid = 0;  // Bit m set once blockedBy[m] is filled in
+    int width = grid.getWidth();
+    std::uint64_t open = 0;
+    std::array<std::array<std::uint16_t, PADDED_HEIGHT>, 4> byRotation;   // Packed into the lanes at the end
+
+    for (int rotation = 0; rotation < 4; ++rotation) {
+        const BlockShape& cells = Block::shapeOf(type, rotation);
+        sameCellsAs[rotation] = rotation;
+        for (int other = 0; other < rotation; ++other) {
+            const BlockShape& earlier = Block::shapeOf(type, other);
+            if (earlier.width == cells.width && earlier.height == cells.height && earlier.rows == cells.rows) {
+                sameCellsAs[rotation] = other;
+                break;
+            }
+        }
+
+        for (int i = 0; i < cells.height; ++i) {
+            unsigned int piece = cells.rows[i];
+            if (slid & (1u << piece)) {
+                continue;
+            }
+            slid |= 1u << piece;
+            for (int y = firstRow; y < height + 7; y += 4) {   // Read up to 6 rows past the bottom below
+                std::uint64_t four = loadRows(&padded[y]);
+                std::uint64_t blocked = 0;
+                for (unsigned int mask = piece; mask; mask &= mask - 1) {
+                    blocked |= shiftRight(four, std::countr_zero(mask));
+                }
+                std::memcpy(&blockedBy[piece][y], &blocked, sizeof blocked);
+            }
+        }
+
+        std::uint64_t inside = cells.width <= width ? (1u << (width - cells.width + 1)) - 1 : 0;
+        open |= inside << (16 * rotation);
+        for (int y = firstRow; y <= height; y += 4) {
+            std::uint64_t blocked = 0;
+            for (int i = 0; i < cells.height; ++i) {
+                blocked |= loadRows(&blockedBy[cells.rows[i]][y + i]);
+            }
+            std::uint64_t word = inside * LANES & ~blocked;
+            std::memcpy(&byRotation[rotation][y], &word, sizeof word);
+        }
+    }
+    for (int y = firstRow; y <= height; ++y) {
+        fits[y] = byRotation[0][y] | std::uint64_t{byRotation[1][y]} << 16 |
+                  std::uint64_t{byRotation[2][y]} << 32 | std::uint64_t{byRotation[3][y]} << 48;
+    }
+    std::fill(fits.begin(), fits.begin() + firstRow, open);
+}
+
+Block PlacementFinder::blockAt(const Placement& placement, int color) const {
+    return Block(type, color, placement.x, placement.y, placement.rotation);
+}
+
+// Layer n holds the positions first reached after n inputs. Once the
+// placement turns up, the path is walked back one layer at a time, taking
+// a drop whenever one leads there, so the moves down come last and the
+// piece is turned and moved while it is still high up.
+std::vector<InputAction> PlacementFinder::pathTo(const Placement& placement) const {
+    auto has = [](const Rows& layer, int rotation, int y, int x) {
+        return y >= 0 && x >= 0 && x < Grid::MAX_WIDTH && ((layer[y] >> (16 * rotation + x)) & 1);
+    };
+
+    std::vector<Rows> layers(1);
+    layers[0][start.getY()] = std::uint64_t{1} << (16 * start.getRotation() + start.getX());
+    Rows visited = layers[0];
+    while (!has(layers.back(), placement.rotation, placement.y, placement.x)) {
+        const Rows& frontier = layers.back();
+        Rows next{};
+        std::uint64_t grew = 0;
+        for (int y = start.getY(); y < height; ++y) {
+            std::uint64_t from = frontier[y];
+            next[y] |= (shiftLeft(from, 1) | shiftRight(from, 1) | rotateLanes(from)) & fits[y] & ~visited[y];
+            next[y + 1] |= from & fits[y + 1] & ~visited[y + 1];
+        }
+        for (int y = start.getY(); y <= height; ++y) {
+            visited[y] |= next[y];
+            grew |= next[y];
+        }
+        if (!grew) {
+            return {};  // Not reachable from the start
+        }
+        layers.push_back(next);
+    }
+
+    std::vector<InputAction> path(layers.size() - 1);
+    int x = placement.x;
+    int y = placement.y;
+    int rotation = placement.rotation;
+    for (std::size_t moves = path.size(); moves > 0; --moves) {
+        const Rows& earlier = layers[moves - 1];
+        InputAction& action = path[moves - 1];
+        if (has(earlier, rotation, y - 1, x)) {
+            action = InputAction::Down;
+            --y;
+        } else if (has(earlier, rotation, y, x + 1)) {
+            action = InputAction::Left;
+            ++x;
+        } else if (has(earlier, rotation, y, x - 1)) {
+            action = InputAction::Right;
+            --x;
+        } else {
+            action = InputAction::Rotate;
+            rotation = (rotation + 3) & 3;
+        }
+    }
+    return path;
+}
@@ -0,0 +1,113 @@
+#include "Protocol.h"
+#include <charconv>
+
+std::string encodeMessage(Opcode opcode, std::string_view payload) {
+    std::string datagram;
+    datagram.reserve(payload.size() + MESSAGE_HEADER_SIZE);
+    datagram.push_back(static_cast<char>(opcode));
+    appendU16(datagram, 0);
+    datagram.append(payload);
+    return datagram;
+}
+
+void setMessageSequence(std::string& datagram, std::uint16_t sequence) {
+    datagram[1] = static_cast<char>(sequence >> 8);
+    datagram[2] = static_cast<char>(sequence & 0xFF);
+}
+
+bool decodeMessage(std::string_view datagram, Opcode& opcode, std::uint16_t& sequence, std::string_view& payload) {
+    if (datagram.size() < MESSAGE_HEADER_SIZE) {
+        return false;
+    }
+    opcode = static_cast<Opcode>(static_cast<std::uint8_t>(datagram[0]));
+    sequence = readU16(datagram.data() + 1);
+    payload = datagram.substr(MESSAGE_HEADER_SIZE);
+    return true;
+}
+
+void appendFrame(std::string& out, Opcode opcode, std::string_view payload) {
+    out.push_back(static_cast<char>(opcode));
+    appendU16(out, static_cast<std::uint16_t>(payload.size()));
+    out.append(payload);
+}
+
+void appendU16(std::string& out, std::uint16_t value) {
+    out.push_back(static_cast<char>(value >> 8));
+    out.push_back(static_cast<char>(value & 0xFF));
+}
+
+void appendU32(std::string& out, std::uint32_t value) {
+    appendU16(out, static_cast<std::uint16_t>(value >> 16));
+    appendU16(out, static_cast<std::uint16_t>(value & 0xFFFF));
+}
+
+void appendU64(std::string& out, std::uint64_t value) {
+    appendU32(out, static_cast<std::uint32_t>(value >> 32));
+    appendU32(out, static_cast<std::uint32_t>(value & 0xFFFFFFFF));
+}
+
+std::uint16_t readU16(const char* data) {
+    auto bytes = reinterpret_cast<const unsigned char*>(data);
+    return static_cast<std::uint16_t>((bytes[0] << 8) | bytes[1]);
+}
+
+std::uint32_t readU32(const char* data) {
+    return (static_cast<std::uint32_t>(readU16(data)) << 16) | readU16(data + 2);
+}
+
+std::uint64_t readU64(const char* data) {
+    return (static_cast<std::uint64_t>(readU32(data)) << 32) | readU32(data + 4);
+}
+
+// Parse an unsigned number that must end exactly at the end of the text
+template <typename T>
+static bool parseNumber(std::string_view text, T& value) {
+    const char* end = text.data() + text.size();
+    auto result = std::from_chars(text.data(), end, value);
+    return result.ec == std::errc() && result.ptr == end;
+}
+
+bool parseEndpoint(std::string_view text, boost::asio::ip::udp::endpoint& endpoint) {
+    auto delimiterPos = text.rfind(':');
+    if (delimiterPos == std::string_view::npos) {
+        return false;
+    }
+    std::string_view ip = text.substr(0, delimiterPos);
+    unsigned short port = 0;
+    if (!parseNumber(text.substr(delimiterPos + 1), port)) {
+        return false;
+    }
+
+    // Dotted IPv4 is parsed in place, anything else goes through asio
+    boost::asio::ip::address_v4::bytes_type bytes;
+    std::size_t octet = 0;
+    bool isV4 = false;
+    std::string_view rest = ip;
+    while (octet < bytes.size()) {
+        std::size_t dot = rest.find('.');
+        if (!parseNumber(rest.substr(0, dot), bytes[octet])) {
+            break;
+        }
+        ++octet;
+        if (dot == std::string_view::npos) {
+            isV4 = octet == bytes.size();
+            break;
+        }
+        rest.remove_prefix(dot + 1);
+    }
+
+    try {
+        if (isV4) {
+            endpoint = boost::asio::ip::udp::endpoint(boost::asio::ip::address_v4(bytes), port);
+        } else {
+            endpoint = boost::asio::ip::udp::endpoint(boost::asio::ip::make_address(ip), port);
+        }
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+std::string formatEndpoint(const boost::asio::ip::udp::endpoint& endpoint) {
+    return endpoint.address().to_string() + ":" + std::to_string(endpoint.port());
+}
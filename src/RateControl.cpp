@@ -0,0 +1,39 @@
+#include "RateControl.h"
+#include <algorithm>
+
+void SendRateController::refill(std::uint32_t nowMs) {
+    // A full message is always allowed to build up, even at the lowest rate
+    double burst = std::max(rateBytes * BURST_SECONDS, 1500.0);
+    if (!started) {
+        started = true;
+        tokens = burst;
+    } else {
+        tokens = std::min(burst, tokens + rateBytes * (nowMs - lastRefillMs) / 1000.0);
+    }
+    lastRefillMs = nowMs;
+}
+
+bool SendRateController::trySend(std::size_t bytes, std::uint32_t nowMs) {
+    refill(nowMs);
+    if (tokens < static_cast<double>(bytes)) {
+        return false;
+    }
+    tokens -= static_cast<double>(bytes);
+    return true;
+}
+
+void SendRateController::onFeedback(double lossRate, double rttMs, std::uint32_t nowMs) {
+    double elapsed = lastFeedbackMs ? (nowMs - lastFeedbackMs) / 1000.0 : 1.0;
+    lastFeedbackMs = nowMs;
+    if (rttMs > 0.0 && (baseRttMs == 0.0 || rttMs < baseRttMs)) {
+        baseRttMs = rttMs;
+    }
+
+    bool congested = lossRate > LOSS_THRESHOLD || (baseRttMs > 0.0 && rttMs > baseRttMs + QUEUE_DELAY_THRESHOLD_MS);
+    if (congested) {
+        rateBytes = std::max(MIN_RATE, rateBytes * DECREASE_FACTOR);
+        lastDecreaseMs = nowMs;
+    } else {
+        rateBytes = std::min(MAX_RATE, rateBytes + INCREASE_PER_SECOND * std::min(elapsed, 2.0));
+    }
+}
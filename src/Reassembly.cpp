@@ -0,0 +1,80 @@
+#include "Reassembly.h"
+#include <algorithm>
+
+static_assert(MAX_FRAGMENTS <= 64, "the received parts are tracked in a 64 bit mask");
+
+bool FragmentReassembler::add(const boost::asio::ip::udp::endpoint& sender, std::string_view fragment, std::uint32_t nowMs,
+                              Opcode& opcode, std::string& message) {
+    if (fragment.size() < FRAGMENT_HEADER_SIZE) {
+        return false;
+    }
+    std::uint16_t messageId = readU16(fragment.data());
+    auto index = static_cast<std::uint8_t>(fragment[2]);
+    auto count = static_cast<std::uint8_t>(fragment[3]);
+    auto fragmentOpcode = static_cast<Opcode>(static_cast<std::uint8_t>(fragment[4]));
+    if (count == 0 || count > MAX_FRAGMENTS || index >= count) {
+        return false;
+    }
+
+    expire(nowMs);
+    Pending& entry = findOrStart(sender, messageId, nowMs);
+    if (entry.count != count || entry.opcode != fragmentOpcode) {
+        // A new message that reuses the id of a stale one
+        if (entry.receivedMask) {
+            ++droppedCount;
+        }
+        entry.opcode = fragmentOpcode;
+        entry.count = count;
+        entry.receivedMask = 0;
+        entry.startedMs = nowMs;
+        entry.parts.assign(count, std::string());
+    }
+
+    std::uint64_t bit = std::uint64_t{1} << index;
+    if (entry.receivedMask & bit) {
+        return false; // Duplicate
+    }
+    entry.receivedMask |= bit;
+    entry.parts[index].assign(fragment.substr(FRAGMENT_HEADER_SIZE));
+    if (entry.receivedMask != (count == 64 ? ~std::uint64_t{0} : (std::uint64_t{1} << count) - 1)) {
+        return false;
+    }
+
+    opcode = entry.opcode;
+    message.clear();
+    for (const auto& part : entry.parts) {
+        message += part;
+    }
+    pending.erase(pending.begin() + (&entry - pending.data()));
+    return true;
+}
+
+FragmentReassembler::Pending& FragmentReassembler::findOrStart(const boost::asio::ip::udp::endpoint& sender,
+                                                               std::uint16_t messageId, std::uint32_t nowMs) {
+    for (auto& entry : pending) {
+        if (entry.messageId == messageId && entry.sender == sender) {
+            return entry;
+        }
+    }
+    if (pending.size() >= MAX_PENDING) {
+        // Make room by giving up on the oldest message
+        auto oldest = std::min_element(pending.begin(), pending.end(), [nowMs](const Pending& a, const Pending& b) {
+            return nowMs - a.startedMs > nowMs - b.startedMs;
+        });
+        pending.erase(oldest);
+        ++droppedCount;
+    }
+    Pending& entry = pending.emplace_back();
+    entry.sender = sender;
+    entry.messageId = messageId;
+    entry.startedMs = nowMs;
+    return entry;
+}
+
+void FragmentReassembler::expire(std::uint32_t nowMs) {
+    auto stale = std::remove_if(pending.begin(), pending.end(), [nowMs](const Pending& entry) {
+        return nowMs - entry.startedMs > TIMEOUT_MS;
+    });
+    droppedCount += static_cast<std::size_t>(pending.end() - stale);
+    pending.erase(stale, pending.end());
+}
@@ -0,0 +1,185 @@
+#include "RemotePlayerView.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+
+// Split off the text before the delimiter, false when nothing is left
+static bool nextField(std::string_view& text, char delimiter, std::string_view& field) {
+    if (text.empty()) {
+        return false;
+    }
+    std::size_t pos = text.find(delimiter);
+    field = text.substr(0, pos);
+    text.remove_prefix(pos == std::string_view::npos ? text.size() : pos + 1);
+    return true;
+}
+
+template <typename T>
+static bool parseField(std::string_view text, char delimiter, std::string_view& rest, T& value) {
+    std::string_view field;
+    rest = text;
+    if (!nextField(rest, delimiter, field)) {
+        return false;
+    }
+    auto result = std::from_chars(field.data(), field.data() + field.size(), value);
+    return result.ec == std::errc();
+}
+
+// Rows of comma separated cells ending with ';', as written by Grid::serialize and Block::serialize
+static int parseCellRows(std::string_view text, std::uint16_t* rows, int maxRows, int& width) {
+    int rowIdx = 0;
+    width = 0;
+    std::string_view rowText;
+    while (rowIdx < maxRows && nextField(text, ';', rowText)) {
+        std::uint16_t mask = 0;
+        int colIdx = 0;
+        std::string_view cell;
+        while (nextField(rowText, ',', cell)) {
+            if (!cell.empty() && cell != "0") {
+                mask |= static_cast<std::uint16_t>(1u << colIdx);
+            }
+            ++colIdx;
+        }
+        width = std::max(width, colIdx);
+        rows[rowIdx++] = mask;
+    }
+    return rowIdx;
+}
+
+bool parseBoardSnapshot(std::string_view text, BoardSnapshot& snapshot) {
+    std::string_view gridText, blockText, rest;
+    if (!nextField(text, '|', gridText) || !nextField(text, '|', blockText)) {
+        return false;
+    }
+
+    snapshot.rows.fill(0);
+    int width = 0;
+    parseCellRows(gridText, snapshot.rows.data(), BoardSnapshot::HEIGHT, width);
+
+    if (!parseField(blockText, ';', rest, snapshot.pieceType) ||
+        !parseField(rest, ';', rest, snapshot.pieceColor) ||
+        !parseField(rest, ';', rest, snapshot.pieceX) ||
+        !parseField(rest, ';', rest, snapshot.pieceY)) {
+        return false;
+    }
+    std::array<std::uint16_t, 4> pieceRows{};
+    snapshot.pieceHeight = parseCellRows(rest, pieceRows.data(), static_cast<int>(pieceRows.size()), snapshot.pieceWidth);
+    for (std::size_t i = 0; i < pieceRows.size(); ++i) {
+        snapshot.pieceRows[i] = static_cast<std::uint8_t>(pieceRows[i]);
+    }
+
+    return parseField(text, '|', text, snapshot.score) &&
+           parseField(text, '|', text, snapshot.speed) &&
+           parseField(text, '|', text, snapshot.timeMs) &&
+           parseField(text, '|', text, snapshot.tick);
+}
+
+bool BoardSnapshot::collides(int x, int y) const {
+    for (int i = 0; i < pieceHeight; ++i) {
+        int row = y + i;
+        if (!pieceRows[i]) {
+            continue;
+        }
+        if (row >= HEIGHT || x < 0 || x + pieceWidth > WIDTH) {
+            return true;
+        }
+        if (row >= 0 && (rows[row] & (pieceRows[i] << x))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const BoardSnapshot& RemotePlayerView::at(std::size_t age) const {
+    return snapshots[(newest + BUFFER_SIZE - age) % BUFFER_SIZE];
+}
+
+void RemotePlayerView::push(const BoardSnapshot& snapshot, Uint32 arrivalMs) {
+    // Drop duplicates and packets older than what we already have
+    if (count > 0 && static_cast<std::int32_t>(snapshot.timeMs - at(0).timeMs) <= 0) {
+        return;
+    }
+    if (count > 0) {
+        double interval = static_cast<double>(snapshot.timeMs - at(0).timeMs);
+        intervalMs += (interval - intervalMs) / 8.0;
+    }
+
+    newest = (newest + 1) % BUFFER_SIZE;
+    snapshots[newest] = snapshot;
+    offsetsMs[newest] = static_cast<std::int64_t>(arrivalMs) - snapshot.timeMs;
+    count = std::min(count + 1, BUFFER_SIZE);
+
+    // The smallest one way offset in the buffer is the least delayed packet.
+    // Older snapshots drop out of it, so an early outlier does not stay.
+    clockOffsetMs = offsetsMs[newest];
+    for (std::size_t age = 1; age < count; ++age) {
+        clockOffsetMs = std::min(clockOffsetMs, offsetsMs[(newest + BUFFER_SIZE - age) % BUFFER_SIZE]);
+    }
+    updateDelay();
+}
+
+void RemotePlayerView::setNetworkEstimate(double rtt, double jitter) {
+    rttMs = rtt;
+    jitterMs = jitter;
+    updateDelay();
+}
+
+// One snapshot interval plus enough margin for the measured jitter and part of the RTT
+void RemotePlayerView::updateDelay() {
+    double delay = intervalMs + 2.0 * jitterMs + rttMs / 8.0;
+    delayMs = static_cast<Uint32>(std::clamp(delay, static_cast<double>(MIN_DELAY_MS), static_cast<double>(MAX_DELAY_MS)));
+}
+
+// Same piece still falling: same grid and the piece did not move up
+static bool samePiece(const BoardSnapshot& from, const BoardSnapshot& to) {
+    return from.pieceType == to.pieceType && from.rows == to.rows &&
+           from.pieceRows == to.pieceRows && to.pieceY >= from.pieceY;
+}
+
+bool RemotePlayerView::sample(Uint32 nowMs, BoardSnapshot& board, float& pieceX, float& pieceY) const {
+    if (count == 0) {
+        return false;
+    }
+
+    // Render time on the sender clock
+    std::int64_t renderTime = static_cast<std::int64_t>(nowMs) - clockOffsetMs - delayMs;
+
+    const BoardSnapshot& latest = at(0);
+    if (renderTime >= static_cast<std::int64_t>(latest.timeMs)) {
+        // Late packets: let gravity keep pulling the piece for a bounded time
+        board = latest;
+        pieceX = static_cast<float>(latest.pieceX);
+        std::int64_t late = std::min<std::int64_t>(renderTime - latest.timeMs, MAX_EXTRAPOLATION_MS);
+        float fall = latest.speed ? static_cast<float>(late) / latest.speed : 0.0f;
+        int landing = latest.pieceY;
+        while (landing - latest.pieceY < static_cast<int>(std::ceil(fall)) && !latest.collides(latest.pieceX, landing + 1)) {
+            ++landing;
+        }
+        pieceY = std::min(static_cast<float>(latest.pieceY) + fall, static_cast<float>(landing));
+        return true;
+    }
+
+    for (std::size_t age = 1; age < count; ++age) {
+        const BoardSnapshot& from = at(age);
+        if (static_cast<std::int64_t>(from.timeMs) > renderTime) {
+            continue;
+        }
+        const BoardSnapshot& to = at(age - 1);
+        board = from;
+        if (samePiece(from, to)) {
+            float t = static_cast<float>(renderTime - from.timeMs) / static_cast<float>(to.timeMs - from.timeMs);
+            pieceX = from.pieceX + (to.pieceX - from.pieceX) * t;
+            pieceY = from.pieceY + (to.pieceY - from.pieceY) * t;
+        } else {
+            pieceX = static_cast<float>(from.pieceX);
+            pieceY = static_cast<float>(from.pieceY);
+        }
+        return true;
+    }
+
+    // Render time is older than the whole buffer
+    board = at(count - 1);
+    pieceX = static_cast<float>(board.pieceX);
+    pieceY = static_cast<float>(board.pieceY);
+    return true;
+}
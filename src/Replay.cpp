@@ -0,0 +1,122 @@
+#include "Replay.h"
+#include <fstream>
+#include <iterator>
+
+static constexpr std::string_view REPLAY_MAGIC = "TRPL";
+static constexpr unsigned ACTION_BITS = 3;
+static constexpr std::uint64_t ACTION_MASK = (1u << ACTION_BITS) - 1;
+static constexpr std::uint8_t MAX_ACTION = static_cast<std::uint8_t>(InputAction::Drop);
+
+void appendVarint(std::string& out, std::uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+bool readVarint(std::string_view& in, std::uint64_t& value) {
+    value = 0;
+    for (unsigned shift = 0; shift < 64 && !in.empty(); shift += 7) {
+        auto byte = static_cast<std::uint8_t>(in.front());
+        in.remove_prefix(1);
+        value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool readU32(std::string_view& in, std::uint32_t& value) {
+    std::uint64_t wide = 0;
+    if (!readVarint(in, wide) || wide > UINT32_MAX) {
+        return false;
+    }
+    value = static_cast<std::uint32_t>(wide);
+    return true;
+}
+
+void Replay::clear() {
+    seed = 0;
+    settings = ReplaySettings{};
+    events.clear();
+    finalTick = 0;
+    finalScore = 0;
+}
+
+std::string Replay::encode() const {
+    std::string out(REPLAY_MAGIC);
+    out.push_back(static_cast<char>(VERSION));
+    appendVarint(out, seed);
+    for (std::uint32_t value : {settings.width, settings.height, settings.tickMs,
+                                settings.initialSpeed, settings.minSpeed, settings.speedStep}) {
+        appendVarint(out, value);
+    }
+
+    // Inputs are sparse in time, so most of them fit in one or two bytes
+    appendVarint(out, events.size());
+    std::uint32_t lastTick = 0;
+    for (const ReplayEvent& event : events) {
+        std::uint64_t delta = event.tick - lastTick;
+        appendVarint(out, (delta << ACTION_BITS) | static_cast<std::uint8_t>(event.action));
+        lastTick = event.tick;
+    }
+
+    appendVarint(out, finalTick);
+    appendVarint(out, finalScore);
+    return out;
+}
+
+bool Replay::decode(std::string_view data) {
+    clear();
+    if (data.size() < REPLAY_MAGIC.size() + 1 || data.substr(0, REPLAY_MAGIC.size()) != REPLAY_MAGIC ||
+        static_cast<std::uint8_t>(data[REPLAY_MAGIC.size()]) != VERSION) {
+        return false;
+    }
+    data.remove_prefix(REPLAY_MAGIC.size() + 1);
+
+    std::uint64_t count = 0;
+    if (!readVarint(data, seed) ||
+        !readU32(data, settings.width) || !readU32(data, settings.height) ||
+        !readU32(data, settings.tickMs) || !readU32(data, settings.initialSpeed) ||
+        !readU32(data, settings.minSpeed) || !readU32(data, settings.speedStep) ||
+        !readVarint(data, count) || count > data.size()) {
+        return false;
+    }
+
+    events.reserve(count);
+    std::uint64_t tick = 0;
+    for (std::uint64_t i = 0; i < count; ++i) {
+        std::uint64_t packed = 0;
+        if (!readVarint(data, packed) || (packed & ACTION_MASK) > MAX_ACTION) {
+            return false;
+        }
+        tick += packed >> ACTION_BITS;
+        if (tick > UINT32_MAX) {
+            return false;
+        }
+        events.push_back({static_cast<std::uint32_t>(tick), static_cast<InputAction>(packed & ACTION_MASK)});
+    }
+
+    return readU32(data, finalTick) && readU32(data, finalScore) && data.empty();
+}
+
+bool Replay::save(const std::string& path) const {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        return false;
+    }
+    std::string data = encode();
+    file.write(data.data(), static_cast<std::streamsize>(data.size()));
+    return static_cast<bool>(file);
+}
+
+bool Replay::load(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return decode(data);
+}
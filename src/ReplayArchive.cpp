@@ -0,0 +1,171 @@
+#include "ReplayArchive.h"
+#include "Game.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <type_traits>
+
+static constexpr char ARCHIVE_MAGIC[4] = {'T', 'R', 'P', 'A'};
+
+// Records are read straight out of the mapping, at any offset
+static_assert(alignof(ReplayKeyframe) == 1 && alignof(ArchiveEntry) == 1 && alignof(ArchiveHeader) == 1);
+static_assert(std::is_trivially_copyable_v<ReplayKeyframe> && std::is_trivially_copyable_v<ArchiveEntry>);
+
+std::vector<ReplayKeyframe> buildKeyframes(const Replay& replay, std::uint32_t interval) {
+    std::vector<ReplayKeyframe> keyframes;
+    if (!(replay.settings == Game::settings()) || interval == 0) {
+        return keyframes;
+    }
+    Game game(nullptr);
+    game.startPlayback(replay);
+    while (!game.isGameOver() && game.getTick() < replay.finalTick) {
+        game.step();
+        if (game.getTick() % interval == 0) {
+            keyframes.push_back(game.captureKeyframe());
+        }
+    }
+    return keyframes;
+}
+
+bool ReplayArchive::open(const std::string& path) {
+    close();
+    try {
+        file = boost::interprocess::file_mapping(path.c_str(), boost::interprocess::read_only);
+        region = boost::interprocess::mapped_region(file, boost::interprocess::read_only);
+    } catch (const boost::interprocess::interprocess_exception&) {
+        close();
+        return false;
+    }
+    data = static_cast<const char*>(region.get_address());
+    dataSize = region.get_size();
+
+    if (dataSize < sizeof(ArchiveHeader) || std::memcmp(header().magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0 ||
+        header().version != ARCHIVE_VERSION || header().indexBlockCount > ARCHIVE_MAX_INDEX_BLOCKS ||
+        header().replayCount > static_cast<std::uint64_t>(header().indexBlockCount) * ARCHIVE_ENTRIES_PER_BLOCK) {
+        close();
+        return false;
+    }
+
+    // Check every index block and record once, lookups trust them afterwards
+    const std::size_t blockSize = ARCHIVE_ENTRIES_PER_BLOCK * sizeof(ArchiveEntry);
+    for (std::uint32_t i = 0; i < header().indexBlockCount; ++i) {
+        if (dataSize < blockSize || header().indexBlocks[i] > dataSize - blockSize) {
+            close();
+            return false;
+        }
+    }
+    count = header().replayCount;
+    for (std::size_t i = 0; i < count; ++i) {
+        const ArchiveEntry& record = entry(i);
+        std::uint64_t recordSize = static_cast<std::uint64_t>(record.keyframeCount) * sizeof(ReplayKeyframe) + record.replaySize;
+        if (record.offset > dataSize || recordSize > dataSize - record.offset) {
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+void ReplayArchive::close() {
+    region = boost::interprocess::mapped_region();
+    file = boost::interprocess::file_mapping();
+    data = nullptr;
+    dataSize = 0;
+    count = 0;
+}
+
+const ArchiveHeader& ReplayArchive::header() const {
+    return *reinterpret_cast<const ArchiveHeader*>(data);
+}
+
+std::uint32_t ReplayArchive::keyframeInterval() const {
+    return header().keyframeInterval;
+}
+
+const ArchiveEntry& ReplayArchive::entry(std::size_t index) const {
+    std::uint64_t block = header().indexBlocks[index / ARCHIVE_ENTRIES_PER_BLOCK];
+    return reinterpret_cast<const ArchiveEntry*>(data + block)[index % ARCHIVE_ENTRIES_PER_BLOCK];
+}
+
+bool ReplayArchive::load(std::size_t index, Replay& replay) const {
+    if (index >= count) {
+        return false;
+    }
+    const ArchiveEntry& record = entry(index);
+    const char* encoded = data + record.offset + record.keyframeCount * sizeof(ReplayKeyframe);
+    return replay.decode(std::string_view(encoded, record.replaySize));
+}
+
+// Keyframes are stored in tick order, so this is a binary search
+const ReplayKeyframe* ReplayArchive::keyframeBefore(std::size_t index, std::uint32_t tick) const {
+    if (index >= count) {
+        return nullptr;
+    }
+    const ArchiveEntry& record = entry(index);
+    const auto* first = reinterpret_cast<const ReplayKeyframe*>(data + record.offset);
+    const auto* last = first + record.keyframeCount;
+    const auto* found = std::upper_bound(first, last, tick, [](std::uint32_t value, const ReplayKeyframe& keyframe) {
+        return value < keyframe.tick;
+    });
+    return found == first ? nullptr : found - 1;
+}
+
+bool ReplayArchiveWriter::open(const std::string& path) {
+    if (!std::filesystem::exists(path)) {
+        std::ofstream created(path, std::ios::binary);
+        ArchiveHeader fresh{};
+        std::memcpy(fresh.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+        fresh.version = ARCHIVE_VERSION;
+        fresh.keyframeInterval = ARCHIVE_KEYFRAME_INTERVAL;
+        created.write(reinterpret_cast<const char*>(&fresh), sizeof(fresh));
+        if (!created) {
+            return false;
+        }
+    }
+
+    file.open(path, std::ios::in | std::ios::out | std::ios::binary);
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        return false;
+    }
+    return std::memcmp(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) == 0 &&
+           header.version == ARCHIVE_VERSION && header.indexBlockCount <= ARCHIVE_MAX_INDEX_BLOCKS;
+}
+
+bool ReplayArchiveWriter::append(const Replay& replay) {
+    std::uint32_t index = header.replayCount;
+    std::uint32_t block = index / ARCHIVE_ENTRIES_PER_BLOCK;
+    if (!file.is_open() || block >= ARCHIVE_MAX_INDEX_BLOCKS) {
+        return false;
+    }
+
+    std::vector<ReplayKeyframe> keyframes = buildKeyframes(replay, header.keyframeInterval);
+    std::string encoded = replay.encode();
+
+    file.seekp(0, std::ios::end);
+    ArchiveEntry record{};
+    record.offset = static_cast<std::uint64_t>(file.tellp());
+    record.seed = replay.seed;
+    record.finalTick = replay.finalTick;
+    record.finalScore = replay.finalScore;
+    record.keyframeCount = static_cast<std::uint32_t>(keyframes.size());
+    record.replaySize = static_cast<std::uint32_t>(encoded.size());
+    file.write(reinterpret_cast<const char*>(keyframes.data()), static_cast<std::streamsize>(keyframes.size() * sizeof(ReplayKeyframe)));
+    file.write(encoded.data(), static_cast<std::streamsize>(encoded.size()));
+
+    if (block == header.indexBlockCount) {
+        std::vector<char> empty(ARCHIVE_ENTRIES_PER_BLOCK * sizeof(ArchiveEntry), 0);
+        header.indexBlocks[block] = static_cast<std::uint64_t>(file.tellp());
+        file.write(empty.data(), static_cast<std::streamsize>(empty.size()));
+        header.indexBlockCount = block + 1;
+    }
+    file.seekp(static_cast<std::streamoff>(header.indexBlocks[block] + (index % ARCHIVE_ENTRIES_PER_BLOCK) * sizeof(ArchiveEntry)));
+    file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+    file.flush();
+
+    // The entry only counts once the header says so
+    header.replayCount = index + 1;
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.flush();
+    return static_cast<bool>(file);
+}
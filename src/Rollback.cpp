@@ -0,0 +1,123 @@
+#include "Rollback.h"
+#include "Protocol.h"
+#include <algorithm>
+
+static constexpr std::size_t INPUT_WINDOW_HEADER_SIZE = 21;
+static constexpr std::size_t INPUT_SIZE = 5;
+
+std::string encodeInputWindow(const InputWindow& window) {
+    std::string payload;
+    payload.reserve(INPUT_WINDOW_HEADER_SIZE + window.count * INPUT_SIZE);
+    appendU64(payload, window.seed);
+    appendU32(payload, window.tickBase);
+    appendU32(payload, window.ticksDone);
+    appendU32(payload, window.firstIndex);
+    payload.push_back(static_cast<char>(window.count));
+    for (std::uint32_t i = 0; i < window.count; ++i) {
+        appendU32(payload, window.events[i].tick);
+        payload.push_back(static_cast<char>(window.events[i].action));
+    }
+    return payload;
+}
+
+bool parseInputWindow(std::string_view payload, InputWindow& window) {
+    if (payload.size() < INPUT_WINDOW_HEADER_SIZE) {
+        return false;
+    }
+    window.seed = readU64(payload.data());
+    window.tickBase = readU32(payload.data() + 8);
+    window.ticksDone = readU32(payload.data() + 12);
+    window.firstIndex = readU32(payload.data() + 16);
+    window.count = static_cast<std::uint8_t>(payload[20]);
+    if (window.count > InputWindow::MAX_INPUTS || payload.size() < INPUT_WINDOW_HEADER_SIZE + window.count * INPUT_SIZE) {
+        return false;
+    }
+    const char* input = payload.data() + INPUT_WINDOW_HEADER_SIZE;
+    for (std::uint32_t i = 0; i < window.count; ++i, input += INPUT_SIZE) {
+        auto action = static_cast<std::uint8_t>(input[4]);
+        if (action > static_cast<std::uint8_t>(InputAction::Drop)) {
+            return false;
+        }
+        window.events[i] = {readU32(input), static_cast<InputAction>(action)};
+    }
+    return true;
+}
+
+InputWindow makeInputWindow(const Replay& recording, std::uint32_t tickBase, std::uint32_t ticksDone) {
+    InputWindow window;
+    window.seed = recording.seed;
+    window.tickBase = tickBase;
+    window.ticksDone = ticksDone;
+    window.count = static_cast<std::uint32_t>(std::min(recording.events.size(), InputWindow::MAX_INPUTS));
+    window.firstIndex = static_cast<std::uint32_t>(recording.events.size()) - window.count;
+    std::copy(recording.events.end() - window.count, recording.events.end(), window.events.begin());
+    return window;
+}
+
+RollbackGame::RollbackGame() : simulation(nullptr) {}
+
+bool RollbackGame::addInputs(const InputWindow& window) {
+    if (!started || window.seed != inputs.seed || window.tickBase != tickBase) {
+        // The first inputs of a new game of that player
+        inputs.clear();
+        inputs.seed = window.seed;
+        inputs.settings = Game::settings();
+        simulation.startPlayback(inputs);
+        history.clear();
+        saveState();
+        started = true;
+        broken = false;
+        tickBase = window.tickBase;
+        ticksDone = 0;
+        rollbackFrom = NO_TICK;
+    }
+    if (broken) {
+        return false;
+    }
+    if (window.firstIndex > inputs.events.size()) {
+        // More inputs were lost than one message repeats
+        broken = true;
+        return false;
+    }
+
+    for (std::size_t i = inputs.events.size() - window.firstIndex; i < window.count; ++i) {
+        const ReplayEvent& event = window.events[i];
+        if (event.tick < simulation.getTick()) {
+            rollbackFrom = std::min(rollbackFrom, event.tick);
+        }
+        inputs.events.push_back(event);
+    }
+    ticksDone = std::max(ticksDone, window.ticksDone);
+    return true;
+}
+
+void RollbackGame::advanceTo(std::uint32_t targetTick) {
+    if (!active()) {
+        return;
+    }
+    if (rollbackFrom != NO_TICK) {
+        std::uint32_t depth = simulation.getTick() - rollbackFrom;
+        if (const GameState* saved = history.find(rollbackFrom)) {
+            simulation.restore(*saved);
+        } else {
+            // Older than every saved state, the inputs are all there to start over from the seed
+            simulation.startPlayback(inputs);
+            saveState();
+            ++resimulationCount;
+        }
+        ++rollbackCount;
+        deepestTicks = std::max(deepestTicks, depth);
+        rollbackFrom = NO_TICK;
+    }
+
+    // Predicting too far past the inputs only makes the next correction larger
+    std::uint32_t limit = std::min(targetTick, ticksDone + MAX_PREDICTION_TICKS);
+    while (!simulation.isGameOver() && simulation.getTick() < limit) {
+        simulation.step();
+        saveState();
+    }
+}
+
+void RollbackGame::saveState() {
+    history.save(simulation.save());
+}
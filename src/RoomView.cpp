@@ -46,10 +46,12 @@ void RoomView::setStartGameCallback(std::function<void()> callback) {
 }
 
 void RoomView::addPlayer(const std::string& playerName) {
+    std::lock_guard<std::mutex> lock(playersMutex);
     players.push_back(playerName);
 }
 
 void RoomView::removePlayer(const std::string& playerName) {
+    std::lock_guard<std::mutex> lock(playersMutex);
     players.erase(std::remove(players.begin(), players.end(), playerName), players.end());
 }
 
@@ -109,7 +111,12 @@ void RoomView::renderPlayers() {
     SDL_Color color = {255, 255, 255, 255};
     int yOffset = 50;
 
-    for (const auto& player : players) {
+    std::vector<std::string> currentPlayers;
+    {
+        std::lock_guard<std::mutex> lock(playersMutex);
+        currentPlayers = players;
+    }
+    for (const auto& player : currentPlayers) {
         SDL_Surface* surface = TTF_RenderText_Solid(font, player.c_str(), color);
         if (!surface) {
             logFile << "Failed to create text surface: " << TTF_GetError() << std::endl;
@@ -136,6 +143,7 @@ void RoomView::renderPlayers() {
 }
 
 void RoomView::updatePlayers(const std::vector<std::string>& updatedPlayers) {
+    std::lock_guard<std::mutex> lock(playersMutex);
     players = updatedPlayers;
     log("Player list updated.");
 }
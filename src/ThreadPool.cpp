@@ -0,0 +1,113 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+static thread_local int workerIndex = -1;
+static thread_local const void* workerPool = nullptr;
+
+ThreadPool::ThreadPool(unsigned threadCount) {
+    threadCount = std::max(1u, threadCount);
+    for (unsigned i = 0; i < threadCount; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (unsigned i = 0; i < threadCount; ++i) {
+        threads.emplace_back([this, i]() { workerLoop(static_cast<int>(i)); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+int ThreadPool::currentWorker() const {
+    return workerPool == this ? workerIndex : -1;
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    int self = currentWorker();
+    unsigned target = self >= 0 ? static_cast<unsigned>(self) : nextWorker.fetch_add(1, std::memory_order_relaxed) % size();
+
+    unfinished.fetch_add(1, std::memory_order_relaxed);
+    {
+        // Counted first, and under the sleep lock so a worker cannot miss it between checking and waiting
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queued.fetch_add(1, std::memory_order_release);
+    }
+    {
+        std::lock_guard<std::mutex> lock(workers[target]->mutex);
+        workers[target]->tasks.push_back(std::move(task));
+    }
+    workAvailable.notify_one();
+}
+
+// Own deque first (newest task, still warm in cache), then the oldest task of another worker
+bool ThreadPool::runOne(int self) {
+    std::function<void()> task;
+    if (self >= 0) {
+        Worker& own = *workers[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+        }
+    }
+    if (!task) {
+        unsigned count = size();
+        unsigned start = self >= 0 ? static_cast<unsigned>(self) + 1 : 0;
+        for (unsigned i = 0; i < count && !task; ++i) {
+            Worker& victim = *workers[(start + i) % count];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                steals.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+    if (!task) {
+        return false;
+    }
+
+    queued.fetch_sub(1, std::memory_order_relaxed);
+    task();
+    if (unfinished.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        allDone.notify_all();
+    }
+    return true;
+}
+
+void ThreadPool::workerLoop(int self) {
+    workerIndex = self;
+    workerPool = this;
+    while (true) {
+        if (runOne(self)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        workAvailable.wait(lock, [this]() { return stopping || queued.load(std::memory_order_acquire) > 0; });
+        if (stopping) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::wait() {
+    int self = currentWorker();
+    while (unfinished.load(std::memory_order_acquire) > 0) {
+        if (runOne(self)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        allDone.wait(lock, [this]() {
+            return unfinished.load(std::memory_order_acquire) == 0 || queued.load(std::memory_order_acquire) > 0;
+        });
+    }
+}
@@ -0,0 +1,60 @@
+#include "TranspositionTable.h"
+#include <algorithm>
+#include <bit>
+
+static constexpr std::uint64_t META_BITS = 0xFFFF;
+
+TranspositionTable::TranspositionTable(std::size_t entries)
+    : bucketCount(std::bit_floor(std::max<std::size_t>(entries / BUCKET_SIZE, 1))) {
+    buckets = std::make_unique<Bucket[]>(bucketCount);
+}
+
+bool TranspositionTable::find(std::uint64_t key, double& score) const {
+    for (const Entry& entry : bucketOf(key).entries) {
+        std::uint64_t check = entry.check.load(std::memory_order_relaxed);
+        std::uint64_t bits = entry.score.load(std::memory_order_relaxed);
+        if ((check & META_BITS) && ((check ^ bits ^ key) & ~META_BITS) == 0) {
+            score = std::bit_cast<double>(bits);
+            return true;
+        }
+    }
+    return false;
+}
+
+void TranspositionTable::store(std::uint64_t key, double score, int depth) {
+    Bucket& bucket = bucketOf(key);
+    std::uint64_t bits = std::bit_cast<std::uint64_t>(score);
+    std::uint64_t meta = std::uint64_t{generation} << 8 | static_cast<std::uint8_t>(depth);
+
+    // The same key, else an empty entry, else the one least worth keeping
+    Entry* victim = nullptr;
+    int victimRank = 0;
+    for (Entry& entry : bucket.entries) {
+        std::uint64_t check = entry.check.load(std::memory_order_relaxed);
+        if (((check ^ entry.score.load(std::memory_order_relaxed) ^ key) & ~META_BITS) == 0 || !(check & META_BITS)) {
+            victim = &entry;
+            break;
+        }
+        bool current = ((check >> 8) & 0xFF) == generation;
+        int rank = (current ? 256 : 0) + static_cast<int>(check & 0xFF);
+        if (!victim || rank < victimRank) {
+            victim = &entry;
+            victimRank = rank;
+        }
+    }
+    victim->check.store(((key ^ bits) & ~META_BITS) | meta, std::memory_order_relaxed);
+    victim->score.store(bits, std::memory_order_relaxed);
+}
+
+void TranspositionTable::newSearch() {
+    generation = static_cast<std::uint8_t>(generation % 255 + 1);
+}
+
+void TranspositionTable::clear() {
+    for (std::size_t i = 0; i < bucketCount; ++i) {
+        for (Entry& entry : buckets[i].entries) {
+            entry.check.store(0, std::memory_order_relaxed);
+            entry.score.store(0, std::memory_order_relaxed);
+        }
+    }
+}
@@ -1,7 +1,56 @@
 #include "Application.h"
+#include <cstdlib>
+#include <iostream>
+#include <string>
 
 int main(int argc, char* argv[]) {
+    // tetris --replay FILE [--fast] [--game N] [--tick T], the last two for archives
+    // tetris --impair SPEC plays over a simulated bad link, see parseImpairment
+    // tetris --rollback simulates the other players' games from their inputs
+    // tetris --bot lets the built-in AI play instead of the keyboard, --search makes it look ahead
+    std::string replayPath;
+    ImpairmentSettings impairment;
+    bool realtime = true;
+    bool rollback = false;
+    bool bot = false;
+    bool search = false;
+    std::size_t gameIndex = 0;
+    std::uint32_t startTick = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--replay" && i + 1 < argc) {
+            replayPath = argv[++i];
+        } else if (arg == "--fast") {
+            realtime = false;
+        } else if (arg == "--game" && i + 1 < argc) {
+            gameIndex = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--tick" && i + 1 < argc) {
+            startTick = static_cast<std::uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--impair" && i + 1 < argc) {
+            if (!parseImpairment(argv[++i], impairment)) {
+                std::cerr << "Bad impairment, expected e.g. delay=40,jitter=10,loss=2,dup=1,reorder=5,seed=7" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--rollback") {
+            rollback = true;
+        } else if (arg == "--bot") {
+            bot = true;
+        } else if (arg == "--search") {
+            bot = true;
+            search = true;
+        }
+    }
+
     Application app;
+    if (impairment.active()) {
+        app.setNetworkImpairment(impairment);
+    }
+    app.setRollback(rollback);
+    app.setBot(bot, search);
+    if (!replayPath.empty()) {
+        app.playReplay(replayPath, realtime, gameIndex, startTick);
+        return 0;
+    }
     app.run();
     return 0;
 }
@@ -0,0 +1,138 @@
+// tetris-archive: packs recorded games into a replay archive and reads it back
+//
+//   pack ARCHIVE PATH...       append .trpl files, or every one in a directory
+//   list ARCHIVE               one line per game from the index
+//   seek ARCHIVE GAME TICK     jump to a tick through the nearest keyframe and print the board
+
+#define SDL_MAIN_HANDLED
+#include "Game.h"
+#include "ReplayArchive.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+std::ofstream logFile;
+
+void log(const std::string& message) {
+    if (logFile.is_open()) {
+        logFile << message << std::endl;
+    }
+}
+
+namespace {
+
+void printUsage() {
+    std::cout << "Usage: tetris-archive pack ARCHIVE PATH...\n"
+              << "       tetris-archive list ARCHIVE\n"
+              << "       tetris-archive seek ARCHIVE GAME TICK\n"
+              << "PATH is a .trpl replay or a directory of them. Packing creates the archive if needed\n"
+              << "and appends to it otherwise.\n";
+}
+
+// Files in name order, which is recording order for the game's own replays
+std::vector<std::filesystem::path> collectReplays(const std::vector<std::string>& paths) {
+    std::vector<std::filesystem::path> files;
+    for (const auto& path : paths) {
+        std::error_code error;
+        if (std::filesystem::is_directory(path, error)) {
+            std::vector<std::filesystem::path> found;
+            for (const auto& entry : std::filesystem::directory_iterator(path, error)) {
+                if (entry.is_regular_file() && entry.path().extension() == ".trpl") {
+                    found.push_back(entry.path());
+                }
+            }
+            std::sort(found.begin(), found.end());
+            files.insert(files.end(), found.begin(), found.end());
+        } else {
+            files.emplace_back(path);
+        }
+    }
+    return files;
+}
+
+int pack(const std::string& archivePath, const std::vector<std::string>& paths) {
+    ReplayArchiveWriter writer;
+    if (!writer.open(archivePath)) {
+        std::cerr << "Cannot open archive " << archivePath << std::endl;
+        return 1;
+    }
+    int failed = 0;
+    for (const auto& file : collectReplays(paths)) {
+        Replay replay;
+        if (!replay.load(file.string())) {
+            std::cerr << "Skipping unreadable replay " << file.string() << std::endl;
+            ++failed;
+            continue;
+        }
+        if (!writer.append(replay)) {
+            std::cerr << "Failed to append " << file.string() << std::endl;
+            return 1;
+        }
+    }
+    std::cout << archivePath << ": " << writer.size() << " games" << std::endl;
+    return failed ? 1 : 0;
+}
+
+int list(const std::string& archivePath) {
+    ReplayArchive archive;
+    if (!archive.open(archivePath)) {
+        std::cerr << "Cannot open archive " << archivePath << std::endl;
+        return 1;
+    }
+    std::cout << "game,seed,ticks,score,keyframes,bytes\n";
+    for (std::size_t i = 0; i < archive.size(); ++i) {
+        const ArchiveEntry& entry = archive.entry(i);
+        std::cout << i << ',' << entry.seed << ',' << entry.finalTick << ',' << entry.finalScore << ','
+                  << entry.keyframeCount << ',' << entry.replaySize << '\n';
+    }
+    return 0;
+}
+
+int seek(const std::string& archivePath, std::size_t index, std::uint32_t tick) {
+    ReplayArchive archive;
+    Replay replay;
+    if (!archive.open(archivePath) || !archive.load(index, replay)) {
+        std::cerr << "Cannot read game " << index << " from " << archivePath << std::endl;
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    const ReplayKeyframe* keyframe = archive.keyframeBefore(index, tick);
+    Game game(nullptr);
+    game.seekReplay(replay, keyframe, tick);
+    auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    ReplayKeyframe state = game.captureKeyframe();
+    std::cout << "game " << index << " tick " << game.getTick() << " score " << game.getScore()
+              << (game.isGameOver() ? " (game over)" : "") << '\n'
+              << "from keyframe at tick " << (keyframe ? static_cast<std::uint32_t>(keyframe->tick) : 0u)
+              << ", " << elapsed << " us\n";
+    for (int y = 0; y < Game::GRID_HEIGHT; ++y) {
+        for (int x = 0; x < Game::GRID_WIDTH; ++x) {
+            std::cout << (state.cells[y * Game::GRID_WIDTH + x] ? '#' : '.');
+        }
+        std::cout << '\n';
+    }
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> args(argv + 1, argv + argc);
+    if (args.size() >= 3 && args[0] == "pack") {
+        return pack(args[1], std::vector<std::string>(args.begin() + 2, args.end()));
+    } else if (args.size() == 2 && args[0] == "list") {
+        return list(args[1]);
+    } else if (args.size() == 4 && args[0] == "seek") {
+        return seek(args[1], std::strtoul(args[2].c_str(), nullptr, 10),
+                    static_cast<std::uint32_t>(std::strtoul(args[3].c_str(), nullptr, 10)));
+    }
+    printUsage();
+    return 1;
+}
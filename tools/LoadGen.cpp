@@ -0,0 +1,655 @@
+// tetris-loadgen: simulated clients over loopback against a Network host
+//
+// Every client performs the JOIN_ROOM handshake, marks itself ready and
+// then streams game states to the host and to the other clients, exactly
+// like OnlineGame does. At the end the tool reports throughput, one-way
+// latency percentiles and drop rates on the host and on the clients.
+// With --impair every sender streams over a simulated bad link, seeded so
+// that runs can be compared. Clients follow the host's match clock like the
+// game does, and against an in-process host the tool reports how far off
+// their estimate ended up.
+
+#define SDL_MAIN_HANDLED
+#include "ClockSync.h"
+#include "Impairment.h"
+#include "Network.h"
+#include "NetStats.h"
+#include "Protocol.h"
+#include "Reassembly.h"
+#include <boost/asio.hpp>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using boost::asio::ip::udp;
+
+std::ofstream logFile;
+
+void log(const std::string& message) {
+    if (logFile.is_open()) {
+        logFile << message << std::endl;
+    }
+}
+
+namespace {
+
+struct Options {
+    int clients = 8;
+    double rateHz = 20.0;
+    double durationSeconds = 10.0;
+    int port = 12345;
+    std::string hostAddress;         // Empty: run a host in this process
+    double startTimeoutSeconds = 60.0;
+    ImpairmentSettings impairment;   // Applied once every client streams
+};
+
+const auto START_TIME = std::chrono::steady_clock::now();
+
+std::uint64_t nowMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - START_TIME).count();
+}
+
+// Samples of one direction of traffic
+struct TrafficStats {
+    std::uint64_t messages = 0;
+    std::uint64_t bytes = 0;
+    std::vector<std::uint32_t> latencyUs;
+
+    void merge(const TrafficStats& other) {
+        messages += other.messages;
+        bytes += other.bytes;
+        latencyUs.insert(latencyUs.end(), other.latencyUs.begin(), other.latencyUs.end());
+    }
+};
+
+double percentile(std::vector<std::uint32_t>& samples, double fraction) {
+    if (samples.empty()) {
+        return 0.0;
+    }
+    std::size_t index = std::min(samples.size() - 1, static_cast<std::size_t>(fraction * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+// The send time in microseconds rides in an extra trailing field that the game ignores
+bool readSendTime(std::string_view state, std::uint64_t& sentUs) {
+    std::size_t pos = state.rfind('|');
+    if (pos == std::string_view::npos) {
+        return false;
+    }
+    std::string_view field = state.substr(pos + 1);
+    return std::from_chars(field.data(), field.data() + field.size(), sentUs).ec == std::errc();
+}
+
+// Board that keeps changing like a real game: a piece falls, locks and lines clear
+class BoardModel {
+public:
+    explicit BoardModel(unsigned seed) : rng(seed) { rows.fill(0); }
+
+    void step() {
+        if (++pieceY + 2 >= static_cast<int>(rows.size()) - stackHeight()) {
+            // Lock the piece as a few random cells on top of the stack
+            int row = static_cast<int>(rows.size()) - 1 - stackHeight();
+            if (row >= 0) {
+                rows[row] |= static_cast<std::uint16_t>(rng() & 0x3FF);
+            }
+            for (auto& r : rows) {
+                if (r == 0x3FF) {
+                    r = 0;
+                    score += 100;
+                }
+            }
+            if (stackHeight() > 16) {
+                rows.fill(0);
+            }
+            pieceY = 0;
+            pieceType = static_cast<int>(rng() % 7);
+        }
+    }
+
+    // Same text layout as OnlineGame::syncState
+    std::string serialize(std::uint32_t matchMs, std::uint32_t tick, std::uint64_t timeUs) const {
+        std::string text;
+        text.reserve(512);
+        for (auto row : rows) {
+            for (int j = 0; j < 10; ++j) {
+                text += (row >> j) & 1 ? "1," : "0,";
+            }
+            text += ';';
+        }
+        text += "|" + std::to_string(pieceType) + ";16711680;3;" + std::to_string(pieceY) + ";0,1,0,;1,1,1,;";
+        text += "|" + std::to_string(score) + "|800|" + std::to_string(matchMs) + "|" + std::to_string(tick);
+        text += "|" + std::to_string(timeUs);
+        return text;
+    }
+
+private:
+    int stackHeight() const {
+        int height = 0;
+        for (std::size_t i = 0; i < rows.size(); ++i) {
+            if (rows[i]) {
+                height = static_cast<int>(rows.size() - i);
+                break;
+            }
+        }
+        return height;
+    }
+
+    std::mt19937 rng;
+    std::array<std::uint16_t, 20> rows{};
+    int pieceY = 0;
+    int pieceType = 0;
+    int score = 0;
+};
+
+// One simulated player with its own socket, all handlers run on its strand
+class SimClient {
+public:
+    SimClient(boost::asio::io_context& io, int id, udp::endpoint host, double rateHz)
+        : strand(boost::asio::make_strand(io)), socket(strand), link(socket, strand), sendTimer(strand), pingTimer(strand),
+          host(host), name("Bot " + std::to_string(id)), board(static_cast<unsigned>(id) * 7919u),
+          sendInterval(std::chrono::microseconds(static_cast<long long>(1e6 / rateHz))) {
+        socket.open(udp::v4());
+        socket.bind(udp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+        self = socket.local_endpoint();
+    }
+
+    void start() {
+        boost::asio::post(strand, [this]() {
+            receive();
+            send(Opcode::JoinRoom, name, host);
+        });
+    }
+
+    void stop() {
+        boost::asio::post(strand, [this]() {
+            streaming = false;
+            sendTimer.cancel();
+            pingTimer.cancel();
+            socket.close();
+        });
+    }
+
+    void impair(const ImpairmentSettings& settings) {
+        boost::asio::post(strand, [this, settings]() { link.configure(settings); });
+    }
+
+    // Round trips count from here on, the clock sync pings before ran over a clean link
+    void measureRtt() {
+        boost::asio::post(strand, [this]() { measuringRtt = true; });
+    }
+
+    void stopStreaming() {
+        boost::asio::post(strand, [this]() {
+            streaming = false;
+            measuringRtt = false;
+            sendTimer.cancel();
+        });
+    }
+
+    bool hasJoined() const { return joined.load(); }
+    bool hasStarted() const { return started.load(); }
+
+    // The host's clock as this client estimates it
+    double matchTimeMs() const { return clock.toRemote(nowMicros() / 1000.0); }
+    const ClockSync& clockSync() const { return clock; }
+
+    // Results, read after the io context stopped
+    TrafficStats received;
+    std::uint64_t statesSent = 0;
+    std::uint64_t bytesSent = 0;
+    std::uint64_t statesSentToHost = 0;
+    std::map<udp::endpoint, PeerStats> fromPeers;
+    std::vector<std::uint32_t> rttUs;
+
+private:
+    void receive() {
+        socket.async_receive_from(boost::asio::buffer(buffer), sender,
+            [this](const boost::system::error_code& error, std::size_t bytes) {
+                if (error) {
+                    return;
+                }
+                handle(std::string_view(buffer.data(), bytes));
+                receive();
+            });
+    }
+
+    void handle(std::string_view datagram) {
+        Opcode opcode;
+        std::uint16_t sequence;
+        std::string_view payload;
+        if (!decodeMessage(datagram, opcode, sequence, payload)) {
+            return;
+        }
+        fromPeers[sender].onReceive(sequence, datagram.size());
+        if (opcode == Opcode::Batch) {
+            forEachFrame(payload, [this](Opcode frameOpcode, std::string_view framePayload) {
+                handleMessage(frameOpcode, framePayload);
+            });
+        } else {
+            handleMessage(opcode, payload);
+        }
+    }
+
+    void handleMessage(Opcode opcode, std::string_view payload) {
+        switch (opcode) {
+            case Opcode::PlayerList:
+                if (!joined) {
+                    // Announce ourselves and ready up, the way the room view does
+                    std::string roster(payload);
+                    roster += (roster.empty() ? "" : ",") + name + " (Ready)";
+                    for (const auto& peer : peers) {
+                        send(Opcode::PlayerList, roster, peer);
+                    }
+                    send(Opcode::PlayerList, roster, host);
+                    sendPing();
+                    joined = true;
+                }
+                break;
+            case Opcode::EndpointList:
+                peers.clear();
+                forEachListItem(payload, [this](std::string_view item) {
+                    udp::endpoint endpoint;
+                    if (parseEndpoint(item, endpoint)) {
+                        peers.push_back(endpoint);
+                    }
+                });
+                break;
+            case Opcode::NewClient: {
+                udp::endpoint endpoint;
+                if (parseEndpoint(payload, endpoint) && std::find(peers.begin(), peers.end(), endpoint) == peers.end()) {
+                    peers.push_back(endpoint);
+                }
+                break;
+            }
+            case Opcode::StartGame:
+                if (payload.size() >= 4) {
+                    startTick = readU32(payload.data());
+                }
+                if (!started.exchange(true)) {
+                    streaming = true;
+                    scheduleSend();
+                    schedulePing();
+                }
+                break;
+            case Opcode::GameState: {
+                std::uint64_t sentUs;
+                ++received.messages;
+                received.bytes += payload.size() + MESSAGE_HEADER_SIZE;
+                if (readSendTime(payload, sentUs)) {
+                    received.latencyUs.push_back(static_cast<std::uint32_t>(nowMicros() - sentUs));
+                }
+                break;
+            }
+            case Opcode::Ping:
+                if (payload.size() >= 4) {
+                    // Same reply as Network::handlePing, so the host's rate control gets its feedback
+                    const PeerStats& stats = fromPeers[sender];
+                    std::string reply(payload.substr(0, 4));
+                    appendU32(reply, static_cast<std::uint32_t>(stats.packetsIn - stats.packetsDuplicated));
+                    appendU32(reply, static_cast<std::uint32_t>(stats.packetsLost));
+                    appendU32(reply, static_cast<std::uint32_t>(matchTimeMs()));
+                    send(Opcode::Pong, reply, sender);
+                }
+                break;
+            case Opcode::Pong:
+                if (payload.size() >= 4) {
+                    std::uint64_t now = nowMicros();
+                    std::uint32_t rtt = static_cast<std::uint32_t>(now) - readU32(payload.data());
+                    if (measuringRtt) {
+                        rttUs.push_back(rtt);
+                    }
+                    if (payload.size() >= 16 && isHost(sender)) {
+                        // Same estimate as Network::handlePong, with microsecond ping times
+                        clock.addSample((now - rtt) / 1000.0, readU32(payload.data() + 12), now / 1000.0);
+                        if (!clock.synced()) {
+                            sendPing();
+                        }
+                    }
+                }
+                break;
+            case Opcode::Fragment: {
+                // Large rosters from the host arrive in parts
+                Opcode messageOpcode;
+                std::string message;
+                if (reassembler.add(sender, payload, static_cast<std::uint32_t>(nowMicros() / 1000), messageOpcode, message) &&
+                    messageOpcode != Opcode::Fragment && messageOpcode != Opcode::Batch) {
+                    handleMessage(messageOpcode, message);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    void send(Opcode opcode, std::string_view payload, const udp::endpoint& target) {
+        if (payload.size() > MAX_UNFRAGMENTED_PAYLOAD) {
+            forEachFragment(opcode, payload, nextMessageId++, [this, &target](std::string_view fragment) {
+                send(Opcode::Fragment, fragment, target);
+            });
+            return;
+        }
+        auto datagram = std::make_shared<std::string>(encodeMessage(opcode, payload));
+        setMessageSequence(*datagram, nextSequence[target]++);
+        link.send(datagram, target, [](const boost::system::error_code&, std::size_t) {});
+        if (opcode == Opcode::GameState) {
+            ++statesSent;
+            bytesSent += datagram->size();
+            if (isHost(target)) {
+                ++statesSentToHost;
+            }
+        }
+    }
+
+    // The endpoint list names the host by its LAN address, clients all sit on loopback
+    bool isHost(const udp::endpoint& endpoint) const {
+        return endpoint == host || endpoint.port() == host.port();
+    }
+
+    // Stream the board to every endpoint the host told us about, like broadcastGameState
+    void scheduleSend() {
+        sendTimer.expires_after(sendInterval);
+        sendTimer.async_wait([this](const boost::system::error_code& error) {
+            if (error || !streaming) {
+                return;
+            }
+            board.step();
+            auto matchMs = static_cast<std::uint32_t>(matchTimeMs());
+            std::uint32_t tick = matchMs / MATCH_TICK_MS;
+            if (clock.synced() && static_cast<std::int32_t>(tick - startTick) < 0) {
+                // START_GAME names a tick still ahead, like OnlineGame we wait for it
+                scheduleSend();
+                return;
+            }
+            std::string state = board.serialize(matchMs, tick, nowMicros());
+            bool hostListed = false;
+            for (const auto& peer : peers) {
+                if (peer != self) {
+                    send(Opcode::GameState, state, peer);
+                    hostListed = hostListed || isHost(peer);
+                }
+            }
+            if (!hostListed) {
+                send(Opcode::GameState, state, host);
+            }
+            scheduleSend();
+        });
+    }
+
+    void schedulePing() {
+        pingTimer.expires_after(std::chrono::seconds(1));
+        pingTimer.async_wait([this](const boost::system::error_code& error) {
+            if (error) {
+                return;
+            }
+            sendPing();
+            schedulePing();
+        });
+    }
+
+    void sendPing() {
+        std::string payload;
+        appendU32(payload, static_cast<std::uint32_t>(nowMicros()));
+        send(Opcode::Ping, payload, host);
+    }
+
+    boost::asio::strand<boost::asio::io_context::executor_type> strand;
+    udp::socket socket;
+    ImpairedLink link;
+    boost::asio::steady_timer sendTimer;
+    boost::asio::steady_timer pingTimer;
+    udp::endpoint host;
+    udp::endpoint self;
+    std::string name;
+    BoardModel board;
+    std::chrono::microseconds sendInterval;
+
+    std::array<char, 2048> buffer;
+    udp::endpoint sender;
+    std::vector<udp::endpoint> peers;
+    std::map<udp::endpoint, std::uint16_t> nextSequence;
+    std::uint16_t nextMessageId = 0;
+    FragmentReassembler reassembler;
+    ClockSync clock;
+    std::uint32_t startTick = 0;
+    std::atomic<bool> joined{false};
+    std::atomic<bool> started{false};
+    bool streaming = false;
+    bool measuringRtt = false;
+};
+
+void printUsage() {
+    std::cout << "Usage: tetris-loadgen [options]\n"
+              << "  --clients N         simulated clients (default 8)\n"
+              << "  --rate HZ           game states per second per client (default 20)\n"
+              << "  --duration SECONDS  streaming time (default 10)\n"
+              << "  --host ADDR:PORT    test a running host instead of one in this process\n"
+              << "  --port PORT         port of the in-process host (default 12345)\n"
+              << "  --start-timeout S   how long to wait for START_GAME from a remote host (default 60)\n"
+              << "  --impair SPEC       stream over a simulated link, e.g. delay=40,jitter=10,loss=2,dup=1,reorder=5,seed=7\n"
+              << "                      (times in ms, rates in percent)\n"
+              << "  --log FILE          write the Network log to FILE\n";
+}
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> const char* { return i + 1 < argc ? argv[++i] : nullptr; };
+        const char* value = nullptr;
+        if (arg == "--help" || arg == "-h") {
+            return false;
+        } else if (arg == "--clients" && (value = next())) {
+            options.clients = std::max(1, std::atoi(value));
+        } else if (arg == "--rate" && (value = next())) {
+            options.rateHz = std::max(0.1, std::atof(value));
+        } else if (arg == "--duration" && (value = next())) {
+            options.durationSeconds = std::max(0.1, std::atof(value));
+        } else if (arg == "--host" && (value = next())) {
+            options.hostAddress = value;
+        } else if (arg == "--port" && (value = next())) {
+            options.port = std::atoi(value);
+        } else if (arg == "--start-timeout" && (value = next())) {
+            options.startTimeoutSeconds = std::atof(value);
+        } else if (arg == "--impair" && (value = next())) {
+            if (!parseImpairment(value, options.impairment)) {
+                std::cerr << "Bad impairment: " << value << std::endl;
+                return false;
+            }
+        } else if (arg == "--log" && (value = next())) {
+            logFile.open(value, std::ios::out | std::ios::trunc);
+        } else {
+            std::cerr << "Unknown or incomplete option: " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename Predicate>
+bool waitFor(Predicate predicate, std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!predicate()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return true;
+}
+
+void printRow(const char* role, TrafficStats& stats, double seconds, std::uint64_t expected) {
+    double drop = expected ? 100.0 * (1.0 - static_cast<double>(std::min(stats.messages, expected)) / expected) : 0.0;
+    std::printf("%-8s %10llu %10.0f %12.0f %8.0f %8.0f %8.0f %8.0f %7.2f\n", role,
+                static_cast<unsigned long long>(stats.messages), stats.messages / seconds, stats.bytes / seconds,
+                percentile(stats.latencyUs, 0.5), percentile(stats.latencyUs, 0.9),
+                percentile(stats.latencyUs, 0.99), percentile(stats.latencyUs, 1.0), drop);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 1;
+    }
+
+    // Host under test
+    std::unique_ptr<Network> hostNetwork;
+    std::mutex hostMutex;
+    TrafficStats hostReceived;
+    udp::endpoint hostEndpoint;
+    if (options.hostAddress.empty()) {
+        hostNetwork = std::make_unique<Network>();
+        hostNetwork->startListening(options.port);
+        hostNetwork->initializeEndPoints();
+        hostNetwork->addPlayer("Host (Ready)");
+        hostNetwork->setNotifyGameStateCallback([&](PeerId, std::string_view state) {
+            std::uint64_t sentUs;
+            std::lock_guard<std::mutex> lock(hostMutex);
+            ++hostReceived.messages;
+            hostReceived.bytes += state.size() + MESSAGE_HEADER_SIZE;
+            if (readSendTime(state, sentUs)) {
+                hostReceived.latencyUs.push_back(static_cast<std::uint32_t>(nowMicros() - sentUs));
+            }
+        });
+        hostEndpoint = udp::endpoint(boost::asio::ip::address_v4::loopback(), static_cast<unsigned short>(options.port));
+    } else if (!parseEndpoint(options.hostAddress, hostEndpoint)) {
+        std::cerr << "Invalid host address: " << options.hostAddress << std::endl;
+        return 1;
+    }
+
+    boost::asio::io_context io;
+    auto work = boost::asio::make_work_guard(io);
+    std::vector<std::thread> threads;
+    unsigned threadCount = std::max(2u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < threadCount; ++i) {
+        threads.emplace_back([&io]() { io.run(); });
+    }
+
+    // Join one at a time, the player list protocol is last writer wins
+    std::vector<std::unique_ptr<SimClient>> clients;
+    for (int i = 0; i < options.clients; ++i) {
+        clients.push_back(std::make_unique<SimClient>(io, i + 1, hostEndpoint, options.rateHz));
+        clients.back()->start();
+        if (!waitFor([&]() { return clients.back()->hasJoined(); }, std::chrono::milliseconds(2000))) {
+            std::cerr << "Client " << i + 1 << " got no answer from the host" << std::endl;
+        }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    if (hostNetwork) {
+        std::size_t ready = 0;
+        for (const auto& player : hostNetwork->getPlayerList()) {
+            ready += player.find("(Ready)") != std::string::npos;
+        }
+        std::cout << "Host sees " << ready << " ready players of " << options.clients + 1 << std::endl;
+        hostNetwork->startGameSession();
+    } else {
+        std::cout << "Waiting for the host to start the game..." << std::endl;
+    }
+    auto startTimeout = std::chrono::milliseconds(static_cast<long long>(options.startTimeoutSeconds * 1000));
+    waitFor([&]() {
+        return std::all_of(clients.begin(), clients.end(), [](const auto& client) { return client->hasStarted(); });
+    }, startTimeout);
+
+    // The handshake is not under test, the link goes bad once everyone streams
+    if (options.impairment.active()) {
+        for (std::size_t i = 0; i < clients.size(); ++i) {
+            ImpairmentSettings settings = options.impairment;
+            settings.seed += i + 1;
+            clients[i]->impair(settings);
+        }
+        if (hostNetwork) {
+            hostNetwork->setImpairment(options.impairment);
+        }
+    }
+    for (auto& client : clients) {
+        client->measureRtt();
+    }
+
+    std::uint64_t streamStart = nowMicros();
+    std::this_thread::sleep_for(std::chrono::milliseconds(static_cast<long long>(options.durationSeconds * 1000)));
+    for (auto& client : clients) {
+        client->stopStreaming();
+    }
+    double seconds = (nowMicros() - streamStart) / 1e6;
+    std::this_thread::sleep_for(std::chrono::milliseconds(500)); // Let the last packets arrive
+    for (auto& client : clients) {
+        client->stop();
+    }
+    work.reset();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // Every estimate against the real host clock, read at the same moment
+    std::vector<std::uint32_t> clockErrorUs;
+    if (hostNetwork) {
+        for (const auto& client : clients) {
+            if (client->clockSync().synced()) {
+                double error = client->matchTimeMs() - hostNetwork->getMatchTimeMs();
+                clockErrorUs.push_back(static_cast<std::uint32_t>(std::abs(error) * 1000.0));
+            }
+        }
+        hostNetwork->stopListening();
+    }
+
+    // Aggregate
+    TrafficStats clientReceived;
+    std::uint64_t sent = 0;
+    std::uint64_t sentToHost = 0;
+    std::uint64_t sentBytes = 0;
+    std::uint64_t lost = 0;
+    std::uint64_t reordered = 0;
+    std::uint64_t duplicated = 0;
+    std::vector<std::uint32_t> rtt;
+    int started = 0;
+    for (const auto& client : clients) {
+        clientReceived.merge(client->received);
+        sent += client->statesSent;
+        sentToHost += client->statesSentToHost;
+        sentBytes += client->bytesSent;
+        rtt.insert(rtt.end(), client->rttUs.begin(), client->rttUs.end());
+        started += client->hasStarted();
+        for (const auto& [peer, stats] : client->fromPeers) {
+            lost += stats.packetsLost;
+            reordered += stats.packetsReordered;
+            duplicated += stats.packetsDuplicated;
+        }
+    }
+
+    std::printf("tetris-loadgen: %d clients (%d started), %.1f Hz, %.1f s, host %s%s\n", options.clients, started,
+                options.rateHz, seconds, formatEndpoint(hostEndpoint).c_str(), hostNetwork ? " (in-process)" : "");
+    std::printf("sent     %10llu states %12.0f bytes/s\n", static_cast<unsigned long long>(sent), sentBytes / seconds);
+    std::printf("%-8s %10s %10s %12s %8s %8s %8s %8s %7s\n", "role", "states", "states/s", "bytes/s",
+                "p50 us", "p90 us", "p99 us", "max us", "drop%");
+    if (hostNetwork) {
+        printRow("host", hostReceived, seconds, sentToHost);
+    }
+    printRow("clients", clientReceived, seconds, sent - sentToHost);
+    std::printf("clients saw %llu sequence gaps, %llu reordered and %llu duplicated packets\n",
+                static_cast<unsigned long long>(lost), static_cast<unsigned long long>(reordered),
+                static_cast<unsigned long long>(duplicated));
+    std::printf("rtt to host  p50 %.0f us  p90 %.0f us  p99 %.0f us  (%zu pings)\n",
+                percentile(rtt, 0.5), percentile(rtt, 0.9), percentile(rtt, 0.99), rtt.size());
+    if (hostNetwork) {
+        // The host clock is read in whole ms, so up to 1000 us of this is rounding
+        std::printf("match clock error  p50 %.0f us  max %.0f us  (%zu of %zu clients synced)\n",
+                    percentile(clockErrorUs, 0.5), percentile(clockErrorUs, 1.0), clockErrorUs.size(), clients.size());
+    }
+    return 0;
+}
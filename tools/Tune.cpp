@@ -0,0 +1,478 @@
+// tetris-tune: evolves the bot's evaluation weights by playing games
+//
+// Uses the cross-entropy method, a diagonal relative of CMA-ES: every
+// generation samples weight sets from a normal distribution per weight,
+// plays the same seeded headless games with each, and refits the
+// distribution to the best quarter. All games of a generation run on a
+// work stealing pool. After each generation the state goes to a checkpoint
+// file, and a run started with an existing checkpoint carries on from it.
+
+#define SDL_MAIN_HANDLED
+#include "BatchSimulator.h"
+#include "Bot.h"
+#include "Evaluator.h"
+#include "Game.h"
+#include "Rng.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+std::ofstream logFile;
+static std::mutex logMutex;
+
+void log(const std::string& message) {
+    if (logFile.is_open()) {
+        std::lock_guard<std::mutex> lock(logMutex);
+        logFile << message << std::endl;
+    }
+}
+
+namespace {
+
+constexpr int WEIGHT_COUNT = 7;
+using Weights = std::array<double, WEIGHT_COUNT>;
+
+const std::array<const char*, WEIGHT_COUNT> WEIGHT_NAMES = {
+    "aggregateHeight", "holes", "bumpiness", "rowTransitions", "columnTransitions", "wells", "linesCleared"};
+
+struct Options {
+    unsigned threads = std::thread::hardware_concurrency();
+    int generations = 50;
+    int population = 32;
+    int games = 16;                     // Per weight set
+    std::uint32_t maxTicks = 60000;     // A game still going here counts as survived, about 16 minutes of play
+    std::uint64_t seed = 1;
+    std::string checkpoint = "tune.ckpt";
+    int checkBatch = 0;                 // Steps of the batch simulator check, none to tune
+};
+
+// Everything needed to carry on, written after every generation
+struct TuneState {
+    int generation = 0;
+    Rng rng;
+    Weights mean{};
+    Weights sigma{};
+    Weights best{};
+    double bestLines = -1;
+};
+
+struct GameResult {
+    int lines = 0;
+    std::uint32_t ticks = 0;
+    bool survived = false;
+};
+
+struct Candidate {
+    Weights weights{};
+    std::vector<GameResult> games;
+    double meanLines = 0;
+};
+
+void printUsage() {
+    std::cout << "Usage: tetris-tune [options]\n"
+              << "Evolves the bot's evaluation weights, resuming from the checkpoint if it exists.\n"
+              << "  --generations N   generations to run in total (default 50)\n"
+              << "  --population N    weight sets per generation (default 32)\n"
+              << "  --games N         games per weight set (default 16)\n"
+              << "  --max-ticks N     a game still running after N ticks counts as survived (default 60000)\n"
+              << "  --seed N          seed of the sampling and the games (default 1)\n"
+              << "  --checkpoint FILE where the state is saved and resumed from (default tune.ckpt)\n"
+              << "  --threads N       worker threads (default: one per core)\n"
+              << "  --check-batch N   instead of tuning, step the batch simulator N times on each of its\n"
+              << "                    code paths, compare it with Game and time it\n"
+              << "  --log FILE        write the game log to FILE\n";
+}
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> const char* { return i + 1 < argc ? argv[++i] : nullptr; };
+        const char* value = nullptr;
+        if (arg == "--help" || arg == "-h") {
+            return false;
+        } else if (arg == "--generations" && (value = next())) {
+            options.generations = std::max(1, std::atoi(value));
+        } else if (arg == "--population" && (value = next())) {
+            options.population = std::max(4, std::atoi(value));
+        } else if (arg == "--games" && (value = next())) {
+            options.games = std::max(1, std::atoi(value));
+        } else if (arg == "--max-ticks" && (value = next())) {
+            options.maxTicks = static_cast<std::uint32_t>(std::max(1L, std::atol(value)));
+        } else if (arg == "--seed" && (value = next())) {
+            options.seed = std::strtoull(value, nullptr, 10);
+        } else if (arg == "--checkpoint" && (value = next())) {
+            options.checkpoint = value;
+        } else if (arg == "--threads" && (value = next())) {
+            options.threads = static_cast<unsigned>(std::max(1, std::atoi(value)));
+        } else if (arg == "--check-batch" && (value = next())) {
+            options.checkBatch = std::max(1, std::atoi(value));
+        } else if (arg == "--log" && (value = next())) {
+            logFile.open(value, std::ios::out | std::ios::trunc);
+        } else {
+            std::cerr << "Unknown or incomplete option: " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+Weights toArray(const EvalWeights& weights) {
+    return {weights.aggregateHeight, weights.holes, weights.bumpiness, weights.rowTransitions,
+            weights.columnTransitions, weights.wells, weights.linesCleared};
+}
+
+EvalWeights fromArray(const Weights& values) {
+    EvalWeights weights;
+    weights.aggregateHeight = values[0];
+    weights.holes = values[1];
+    weights.bumpiness = values[2];
+    weights.rowTransitions = values[3];
+    weights.columnTransitions = values[4];
+    weights.wells = values[5];
+    weights.linesCleared = values[6];
+    return weights;
+}
+
+// Box-Muller, one of the pair is dropped to keep the state a single integer
+double normal(Rng& rng) {
+    double u1 = (static_cast<double>(rng.next() >> 11) + 1) / 9007199254740993.0;
+    double u2 = static_cast<double>(rng.next() >> 11) / 9007199254740992.0;
+    return std::sqrt(-2 * std::log(u1)) * std::cos(6.283185307179586 * u2);
+}
+
+TuneState initialState(const Options& options) {
+    TuneState state;
+    state.rng = Rng(options.seed);
+    state.mean = toArray(EvalWeights());
+    for (int i = 0; i < WEIGHT_COUNT; ++i) {
+        state.sigma[i] = 1 + std::abs(state.mean[i]) / 2;
+    }
+    state.best = state.mean;
+    return state;
+}
+
+// Plain text, one field per line, so a run can be inspected or edited
+bool saveCheckpoint(const std::string& path, const TuneState& state) {
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::trunc);
+        out << std::setprecision(17) << "tetris-tune 1\n"
+            << "generation " << state.generation << '\n'
+            << "rng " << state.rng.state << '\n'
+            << "best-lines " << state.bestLines << '\n';
+        auto writeWeights = [&](const char* name, const Weights& weights) {
+            out << name;
+            for (double weight : weights) {
+                out << ' ' << weight;
+            }
+            out << '\n';
+        };
+        writeWeights("mean", state.mean);
+        writeWeights("sigma", state.sigma);
+        writeWeights("best", state.best);
+        if (!out) {
+            return false;
+        }
+    }
+    // Replaced in one step, a crash never leaves half a checkpoint
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    return !error;
+}
+
+bool loadCheckpoint(const std::string& path, TuneState& state) {
+    std::ifstream in(path);
+    std::string magic;
+    int version = 0;
+    if (!(in >> magic >> version) || magic != "tetris-tune" || version != 1) {
+        return false;
+    }
+    std::string key;
+    auto readWeights = [&](Weights& weights) {
+        for (double& weight : weights) {
+            in >> weight;
+        }
+    };
+    while (in >> key) {
+        if (key == "generation") {
+            in >> state.generation;
+        } else if (key == "rng") {
+            in >> state.rng.state;
+        } else if (key == "best-lines") {
+            in >> state.bestLines;
+        } else if (key == "mean") {
+            readWeights(state.mean);
+        } else if (key == "sigma") {
+            readWeights(state.sigma);
+        } else if (key == "best") {
+            readWeights(state.best);
+        } else {
+            return false;
+        }
+        if (!in) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A headless game, played by the bot until it tops out or runs out of time
+GameResult playGame(Game& game, const Weights& weights, std::uint64_t seed, std::uint32_t maxTicks) {
+    game.reset(seed);
+    game.setBot(std::make_unique<Bot>(fromArray(weights)));
+    while (!game.isGameOver() && game.getTick() < maxTicks) {
+        game.step();
+    }
+    game.setBot(nullptr);
+    return {game.getScore() / 100, game.getTick(), !game.isGameOver()};   // Every line scores 100
+}
+
+// One placement in Game the way BatchSimulator::step does it: turns and
+// moves as key presses, then down until it stops and gravity locks it
+void placeInGame(Game& game, const BatchAction& action) {
+    for (int turn = 0; turn < action.rotation && game.applyInput(InputAction::Rotate); ++turn) {
+    }
+    while (game.getCurrentBlock().getX() != action.x &&
+           game.applyInput(action.x > game.getCurrentBlock().getX() ? InputAction::Right : InputAction::Left)) {
+    }
+    while (game.applyInput(InputAction::Down)) {
+    }
+    std::uint64_t hash = game.getGrid().getHash();
+    while (!game.isGameOver() && game.getGrid().getHash() == hash) {
+        game.step();
+    }
+}
+
+// Random actions, half the games aim at their lowest column so lines get cleared
+BatchAction randomAction(Rng& rng, const Grid* aimAt) {
+    BatchAction action;
+    action.rotation = static_cast<std::uint8_t>(rng.nextInt(4));
+    action.x = static_cast<std::int8_t>(rng.nextInt(Game::GRID_WIDTH + 2) - 1);
+    if (aimAt) {
+        int lowest = 0;
+        for (int x = 1; x < aimAt->getWidth(); ++x) {
+            lowest = aimAt->getColumnHeight(x) < aimAt->getColumnHeight(lowest) ? x : lowest;
+        }
+        action.x = static_cast<std::int8_t>(lowest);
+    }
+    return action;
+}
+
+// Steps the batch simulator next to one Game per batch game and counts the
+// boards, scores or game overs that differ, then times a large batch
+bool checkBatch(const Options& options, bool avx2) {
+    constexpr std::size_t CHECK_GAMES = 64;
+    constexpr std::size_t TIMED_GAMES = 4096;
+    BatchSimulator batch(CHECK_GAMES, Game::GRID_WIDTH, Game::GRID_HEIGHT);
+    batch.useAvx2(avx2);
+    if (batch.usesAvx2() != avx2) {
+        return true;    // No AVX2 here, nothing to check
+    }
+
+    Rng rng(options.seed);
+    std::uint64_t nextSeed = options.seed * 1000003;
+    std::vector<std::unique_ptr<Game>> games;
+    for (std::size_t i = 0; i < CHECK_GAMES; ++i) {
+        games.push_back(std::make_unique<Game>(nullptr));
+        games[i]->reset(nextSeed);
+        batch.reset(i, nextSeed++);
+    }
+    std::vector<BatchAction> actions(CHECK_GAMES);
+    std::uint64_t placements = 0;
+    std::uint64_t lines = 0;
+    std::uint64_t mismatches = 0;
+    for (int step = 0; step < options.checkBatch; ++step) {
+        for (std::size_t i = 0; i < CHECK_GAMES; ++i) {
+            actions[i] = randomAction(rng, i % 2 ? &games[i]->getGrid() : nullptr);
+            placeInGame(*games[i], actions[i]);
+        }
+        batch.step(actions);
+        for (std::size_t i = 0; i < CHECK_GAMES; ++i) {
+            Game& game = *games[i];
+            bool same = game.isGameOver() == batch.isGameOver(i) && game.getScore() == batch.getScore(i);
+            for (int y = 0; same && y < Game::GRID_HEIGHT; ++y) {
+                same = game.getGrid().getRow(y) == batch.getRow(i, y);
+            }
+            mismatches += !same;
+            ++placements;
+            if (game.isGameOver() || !same) {
+                lines += static_cast<std::uint64_t>(game.getScore() / 100);
+                game.reset(nextSeed);
+                batch.reset(i, nextSeed++);
+            }
+        }
+    }
+    for (std::size_t i = 0; i < CHECK_GAMES; ++i) {
+        lines += static_cast<std::uint64_t>(games[i]->getScore() / 100);
+    }
+
+    // The actions are drawn up front, so the timing is the simulator alone
+    BatchSimulator timed(TIMED_GAMES, Game::GRID_WIDTH, Game::GRID_HEIGHT);
+    timed.useAvx2(avx2);
+    timed.resetAll(nextSeed);
+    std::vector<std::vector<BatchAction>> timedActions(16, std::vector<BatchAction>(TIMED_GAMES));
+    for (auto& round : timedActions) {
+        for (auto& action : round) {
+            action = randomAction(rng, nullptr);
+        }
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (int step = 0; step < options.checkBatch; ++step) {
+        timed.step(timedActions[static_cast<std::size_t>(step) % timedActions.size()]);
+        for (std::size_t i = 0; i < TIMED_GAMES; ++i) {
+            if (timed.isGameOver(i)) {
+                timed.reset(i, nextSeed++);
+            }
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << (avx2 ? "AVX2" : "Plain") << ": " << mismatches << " of " << placements
+              << " placements differ from Game (" << lines << " lines cleared), "
+              << static_cast<double>(options.checkBatch) * TIMED_GAMES / seconds / 1e6 << " M placements/s\n";
+    return mismatches == 0;
+}
+
+// As the members of EvalWeights, ready to paste over the defaults
+void printWeights(const Weights& weights) {
+    std::cout << std::setprecision(4);
+    for (int i = 0; i < WEIGHT_COUNT; ++i) {
+        std::cout << "    " << WEIGHT_NAMES[i] << " = " << weights[i] << ";\n";
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 1;
+    }
+    if (options.checkBatch) {
+        std::cout << std::fixed << std::setprecision(1);
+        bool avx2 = checkBatch(options, true);
+        bool plain = checkBatch(options, false);
+        return avx2 && plain ? 0 : 1;
+    }
+
+    TuneState state = initialState(options);
+    if (std::filesystem::exists(options.checkpoint)) {
+        if (!loadCheckpoint(options.checkpoint, state)) {
+            std::cerr << "Can not read checkpoint " << options.checkpoint << std::endl;
+            return 1;
+        }
+        std::cout << "Resuming at generation " << state.generation << " from " << options.checkpoint << '\n';
+    }
+
+    ThreadPool pool(options.threads);
+    // One game per worker, reused. The last one is for this thread, which
+    // runs tasks too while it waits.
+    std::vector<std::unique_ptr<Game>> games;
+    for (unsigned i = 0; i <= pool.size(); ++i) {
+        games.push_back(std::make_unique<Game>(nullptr));
+    }
+
+    std::vector<Candidate> candidates(static_cast<std::size_t>(options.population));
+    std::size_t elite = std::max<std::size_t>(2, candidates.size() / 4);
+    std::cout << std::fixed << std::setprecision(1);
+    for (; state.generation < options.generations; ++state.generation) {
+        auto start = std::chrono::steady_clock::now();
+        for (auto& candidate : candidates) {
+            for (int i = 0; i < WEIGHT_COUNT; ++i) {
+                candidate.weights[i] = state.mean[i] + state.sigma[i] * normal(state.rng);
+            }
+            candidate.games.assign(static_cast<std::size_t>(options.games), GameResult());
+        }
+
+        // Every weight set plays the same games, the generation picks the seeds
+        std::uint64_t firstSeed = options.seed * 1000003 + static_cast<std::uint64_t>(state.generation) * options.games;
+        for (auto& candidate : candidates) {
+            for (int i = 0; i < options.games; ++i) {
+                pool.submit([&pool, &games, &candidate, i, firstSeed, &options]() {
+                    int worker = pool.currentWorker();
+                    Game& game = *games[worker >= 0 ? static_cast<std::size_t>(worker) : games.size() - 1];
+                    candidate.games[static_cast<std::size_t>(i)] = playGame(game, candidate.weights, firstSeed + i, options.maxTicks);
+                });
+            }
+        }
+        pool.wait();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::uint64_t ticks = 0;
+        for (auto& candidate : candidates) {
+            double lines = 0;
+            for (const GameResult& result : candidate.games) {
+                lines += result.lines;
+                ticks += result.ticks;
+            }
+            candidate.meanLines = lines / options.games;
+        }
+        std::sort(candidates.begin(), candidates.end(),
+                  [](const Candidate& a, const Candidate& b) { return a.meanLines > b.meanLines; });
+
+        // The best quarter becomes the new distribution. The extra noise
+        // fades over the generations and keeps it from collapsing early.
+        double noise = 1.0 / (1 + state.generation);
+        for (int i = 0; i < WEIGHT_COUNT; ++i) {
+            double sum = 0;
+            for (std::size_t k = 0; k < elite; ++k) {
+                sum += candidates[k].weights[i];
+            }
+            double mean = sum / static_cast<double>(elite);
+            double variance = 0;
+            for (std::size_t k = 0; k < elite; ++k) {
+                variance += (candidates[k].weights[i] - mean) * (candidates[k].weights[i] - mean);
+            }
+            state.mean[i] = mean;
+            state.sigma[i] = std::sqrt(variance / static_cast<double>(elite) + noise);
+        }
+
+        const Candidate& top = candidates.front();
+        if (top.meanLines > state.bestLines) {
+            state.bestLines = top.meanLines;
+            state.best = top.weights;
+        }
+        int fewest = top.games.front().lines;
+        std::size_t survived = 0;
+        double topTicks = 0;
+        for (const GameResult& result : top.games) {
+            fewest = std::min(fewest, result.lines);
+            survived += result.survived;
+            topTicks += result.ticks;
+        }
+        double populationLines = 0;
+        for (const auto& candidate : candidates) {
+            populationLines += candidate.meanLines;
+        }
+
+        std::cout << "Generation " << state.generation + 1 << ": best " << top.meanLines << " lines (fewest "
+                  << fewest << ", " << 100.0 * static_cast<double>(survived) / options.games << "% survived, "
+                  << topTicks / options.games << " ticks), population " << populationLines / options.population
+                  << " lines, " << static_cast<double>(candidates.size() * options.games) / seconds << " games/s, "
+                  << static_cast<double>(ticks) / seconds / 1e6 << " M ticks/s\n";
+
+        TuneState saved = state;
+        ++saved.generation;
+        if (!saveCheckpoint(options.checkpoint, saved)) {
+            std::cerr << "Can not write checkpoint " << options.checkpoint << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "Best weights, " << state.bestLines << " lines per game:\n";
+    printWeights(state.best);
+    return 0;
+}
@@ -0,0 +1,187 @@
+// tetris-verify: re-simulates recorded games and checks their final scores
+//
+// Takes .trpl files, directories of them and replay archives. Every game
+// runs through the headless Game rules on a work stealing pool with one
+// worker per core, so long and short games balance out. The summary
+// doubles as a benchmark of the simulation core (ticks per second).
+
+#define SDL_MAIN_HANDLED
+#include "Game.h"
+#include "ReplayArchive.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+std::ofstream logFile;
+static std::mutex logMutex;
+
+void log(const std::string& message) {
+    if (logFile.is_open()) {
+        std::lock_guard<std::mutex> lock(logMutex);
+        logFile << message << std::endl;
+    }
+}
+
+namespace {
+
+struct Options {
+    unsigned threads = std::thread::hardware_concurrency();
+    int repeat = 1;
+    bool quiet = false;
+    std::vector<std::string> paths;
+};
+
+// A game to check: a file on disk or an entry of an open archive
+struct Job {
+    std::string file;
+    const ReplayArchive* archive = nullptr;
+    std::size_t index = 0;
+
+    std::string name() const { return archive ? file + "#" + std::to_string(index) : file; }
+};
+
+struct Totals {
+    std::atomic<std::size_t> games{0};
+    std::atomic<std::size_t> mismatches{0};
+    std::atomic<std::size_t> unreadable{0};
+    std::atomic<std::uint64_t> ticks{0};
+};
+
+void printUsage() {
+    std::cout << "Usage: tetris-verify [options] PATH...\n"
+              << "PATH is a .trpl replay, a directory of them or a replay archive.\n"
+              << "  --threads N   worker threads (default: one per core)\n"
+              << "  --repeat N    verify everything N times, for benchmarking (default 1)\n"
+              << "  --quiet       only print the summary\n"
+              << "  --log FILE    write the game log to FILE\n";
+}
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> const char* { return i + 1 < argc ? argv[++i] : nullptr; };
+        const char* value = nullptr;
+        if (arg == "--help" || arg == "-h") {
+            return false;
+        } else if (arg == "--threads" && (value = next())) {
+            options.threads = static_cast<unsigned>(std::max(1, std::atoi(value)));
+        } else if (arg == "--repeat" && (value = next())) {
+            options.repeat = std::max(1, std::atoi(value));
+        } else if (arg == "--quiet") {
+            options.quiet = true;
+        } else if (arg == "--log" && (value = next())) {
+            logFile.open(value, std::ios::out | std::ios::trunc);
+        } else if (!arg.empty() && arg[0] != '-') {
+            options.paths.push_back(arg);
+        } else {
+            std::cerr << "Unknown or incomplete option: " << arg << std::endl;
+            return false;
+        }
+    }
+    return !options.paths.empty();
+}
+
+// Expands the paths into jobs, archives stay mapped for the whole run
+bool collectJobs(const std::vector<std::string>& paths, std::vector<std::unique_ptr<ReplayArchive>>& archives,
+                 std::vector<Job>& jobs) {
+    for (const auto& path : paths) {
+        std::error_code error;
+        if (std::filesystem::is_directory(path, error)) {
+            for (const auto& entry : std::filesystem::recursive_directory_iterator(path, error)) {
+                if (entry.is_regular_file() && entry.path().extension() == ".trpl") {
+                    jobs.push_back({entry.path().string()});
+                }
+            }
+            continue;
+        }
+        auto archive = std::make_unique<ReplayArchive>();
+        if (archive->open(path)) {
+            for (std::size_t i = 0; i < archive->size(); ++i) {
+                jobs.push_back({path, archive.get(), i});
+            }
+            archives.push_back(std::move(archive));
+        } else if (std::filesystem::is_regular_file(path, error)) {
+            jobs.push_back({path});
+        } else {
+            std::cerr << "No such replay, directory or archive: " << path << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void verify(const Job& job, Game& game, Totals& totals, bool quiet) {
+    Replay replay;
+    bool loaded = job.archive ? job.archive->load(job.index, replay) : replay.load(job.file);
+    if (!loaded) {
+        ++totals.unreadable;
+        std::lock_guard<std::mutex> lock(logMutex);
+        std::cout << "UNREADABLE " << job.name() << '\n';
+        return;
+    }
+
+    bool matches = game.runReplay(replay);
+    ++totals.games;
+    totals.ticks += game.getTick();
+    if (!matches) {
+        ++totals.mismatches;
+        if (!quiet) {
+            std::lock_guard<std::mutex> lock(logMutex);
+            std::cout << "MISMATCH " << job.name() << ": recorded score " << replay.finalScore << " at tick "
+                      << replay.finalTick << ", simulated " << game.getScore() << " at tick " << game.getTick() << '\n';
+        }
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 1;
+    }
+
+    std::vector<std::unique_ptr<ReplayArchive>> archives;
+    std::vector<Job> jobs;
+    if (!collectJobs(options.paths, archives, jobs)) {
+        return 1;
+    }
+
+    ThreadPool pool(options.threads);
+    // One game per worker, reused across replays. The last one is for this
+    // thread, which runs tasks too while it waits.
+    std::vector<std::unique_ptr<Game>> games;
+    for (unsigned i = 0; i <= pool.size(); ++i) {
+        games.push_back(std::make_unique<Game>(nullptr));
+    }
+
+    Totals totals;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < options.repeat; ++round) {
+        for (const Job& job : jobs) {
+            pool.submit([&pool, &job, &games, &totals, &options]() {
+                int worker = pool.currentWorker();
+                verify(job, *games[worker >= 0 ? static_cast<std::size_t>(worker) : games.size() - 1], totals, options.quiet);
+            });
+        }
+    }
+    pool.wait();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Verified " << totals.games << " games on " << pool.size() << " threads in " << seconds << " s: "
+              << totals.mismatches << " mismatches, " << totals.unreadable << " unreadable\n"
+              << "  " << static_cast<std::uint64_t>(totals.games / seconds) << " games/s, "
+              << static_cast<std::uint64_t>(totals.ticks / seconds) << " ticks/s, "
+              << pool.stealCount() << " tasks stolen\n";
+    return totals.mismatches || totals.unreadable ? 1 : 0;
+}